@@ -8,6 +8,7 @@
 
 #include <phase1.h>
 #include <phase2.h>
+#include <phase4.h>
 #include <libuser.h>
 #include <usyscall.h>
 #include <usloss.h>
@@ -70,6 +71,30 @@ int DiskSize(int unit, int* sectorSize, int* trackSize, int* diskSize)
 } /* end DiskSize */
 
 
+/*
+ *  Routine:  DiskMirrorStats
+ *
+ *  Description: This routin copies the read balancing statistics of the mirrored disk unit into stats.
+ *
+ *  Arguments:    address of a diskMirrorStats structure to fill in
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int DiskMirrorStats(diskMirrorStats *stats)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number = SYS_DISKMIRRORSTATS;
+    sysArg.arg1 = stats;
+    
+    USLOSS_Syscall(&sysArg);
+    
+    return (long) sysArg.arg4;
+} /* end DiskMirrorStats */
+
+
 /*
  *  Routine:  DiskRead
  *
@@ -128,6 +153,98 @@ int DiskWrite(void *dbuff, int unit, int track, int first, int sectors, int *sta
     return (long) sysArg.arg4;
 } /* end DiskWrite */
 
+/*
+ *  Routine:  DiskPread
+ *
+ *  Description: This routin helps user-level processes to read length bytes starting at byte offset of a disk, sector boundaries do not matter.
+ *
+ *  Arguments:   As declared in the function.
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int DiskPread(void *dbuff, int unit, int offset, int length, int *status)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_DISKPREAD;
+    sysArg.arg1     = dbuff;
+    sysArg.arg2     = (void *) ((long) length);
+    sysArg.arg3     = (void *) ((long) offset);
+    sysArg.arg5     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *status = (long) sysArg.arg1;
+    
+    return (long) sysArg.arg4;
+} /* end DiskPread */
+
+/*
+ *  Routine:  DiskPwrite
+ *
+ *  Description: This routin helps user-level processes to write length bytes starting at byte offset of a disk, partial sectors are updated in place by the kernel.
+ *
+ *  Arguments:   As declared in the function.
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int DiskPwrite(void *dbuff, int unit, int offset, int length, int *status)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_DISKPWRITE;
+    sysArg.arg1     = dbuff;
+    sysArg.arg2     = (void *) ((long) length);
+    sysArg.arg3     = (void *) ((long) offset);
+    sysArg.arg5     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *status = (long) sysArg.arg1;
+    
+    return (long) sysArg.arg4;
+} /* end DiskPwrite */
+
+/*
+ *  Routine:  DiskCopy
+ *
+ *  Description: This routin helps user-level processes to copy sectors between two places on the same or different disks without passing them through a user buffer.
+ *
+ *  Arguments:   unit, track and first sector of the source, unit, track and first sector of the destination, number of sectors, status of the transfer
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int DiskCopy(int srcUnit, int srcTrack, int srcFirst, int dstUnit,
+             int dstTrack, int dstFirst, int sectors, int *status)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    // an out of range sector would otherwise land on a valid track below
+    if (srcFirst < 0 || srcFirst >= USLOSS_DISK_TRACK_SIZE ||
+        dstFirst < 0 || dstFirst >= USLOSS_DISK_TRACK_SIZE)
+        return -1;
+    
+    // track and sector travel as one sector number, there are only five arguments
+    sysArg.number   = SYS_DISKCOPY;
+    sysArg.arg1     = (void *) ((long) srcUnit);
+    sysArg.arg2     = (void *) ((long) (srcTrack * USLOSS_DISK_TRACK_SIZE + srcFirst));
+    sysArg.arg3     = (void *) ((long) dstUnit);
+    sysArg.arg4     = (void *) ((long) (dstTrack * USLOSS_DISK_TRACK_SIZE + dstFirst));
+    sysArg.arg5     = (void *) ((long) sectors);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *status = (long) sysArg.arg1;
+    
+    return (long) sysArg.arg4;
+} /* end DiskCopy */
+
 /*
  *  Routine:  TermRead
  *
@@ -181,3 +298,340 @@ int TermWrite(char* buf, int size, int unit, int* sizeWritten)
     
     return (long) sysArg.arg4;
 } /* end TermWrite */
+
+/*
+ *  Routine:    TermControl
+ *
+ *  Description: This routin helps user-level processes to change how a terminal device delivers input, e.g. switch it to raw mode
+ *
+ *  Arguments:   the unit number of the terminal, one of the TERM_CTL_* requests, the new value for it
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermControl(int unit, int request, int value)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMCONTROL;
+    sysArg.arg1     = (void *) ((long) unit);
+    sysArg.arg2     = (void *) ((long) request);
+    sysArg.arg3     = (void *) ((long) value);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    return (long) sysArg.arg4;
+} /* end TermControl */
+
+/*
+ *  Routine:    TermSelect
+ *
+ *  Description: This routin helps user-level processes to wait on several terminal devices at once
+ *
+ *  Arguments:   TERM_SELECT_READ and TERM_SELECT_WRITE bits of the units to wait on, milliseconds to wait (0 polls, negative waits for good), the bits that are ready
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermSelect(int mask, int timeout, int *ready)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMSELECT;
+    sysArg.arg1     = (void *) ((long) mask);
+    sysArg.arg2     = (void *) ((long) timeout);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *ready = (long) sysArg.arg1;
+    
+    return (long) sysArg.arg4;
+} /* end TermSelect */
+
+/*
+ *  Routine:    TermTryRead
+ *
+ *  Description: This routin helps user-level processes to read a line from a terminal device without waiting for one
+ *
+ *  Arguments:   As TermRead.
+ *
+ *  Return Value: -1 if illegal values are given as input; TERM_WOULD_BLOCK if nothing can be read now; 0 otherwise.
+ *
+ */
+int TermTryRead(char* buf, int size, int unit, int* sizeRead)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMTRYREAD;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeRead = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end TermTryRead */
+
+/*
+ *  Routine:    TermTryWrite
+ *
+ *  Description: This routin helps user-level processes to queue a line for a terminal device and return without waiting for it to be written
+ *
+ *  Arguments:   As TermWrite.
+ *
+ *  Return Value: -1 if illegal values are given as input; TERM_WOULD_BLOCK if the line cannot be queued now; 0 otherwise.
+ *
+ */
+int TermTryWrite(char* buf, int size, int unit, int* sizeWritten)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMTRYWRITE;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeWritten = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end TermTryWrite */
+
+/*
+ *  Routine:    TermFlush
+ *
+ *  Description: This routin helps user-level processes to wait until everything written to a terminal device has been transmitted
+ *
+ *  Arguments:   the unit number of the terminal
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermFlush(int unit)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMFLUSH;
+    sysArg.arg1     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    return (long) sysArg.arg4;
+} /* end TermFlush */
+
+/*
+ *  Routine:    TermReadLines
+ *
+ *  Description: This routin helps user-level processes to read every buffered line of a terminal device that fits, waiting only for the first one
+ *
+ *  Arguments:   address of the user's buffer, its size, the unit number of the terminal, array receiving the length of each line, its number of entries, number of lines read
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermReadLines(char* buf, int size, int unit, int* lens, int maxLines, int* linesRead)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMREADLINES;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) unit);
+    sysArg.arg4     = lens;
+    sysArg.arg5     = (void *) ((long) maxLines);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *linesRead = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end TermReadLines */
+
+/*
+ *  Routine:    TermWriteV
+ *
+ *  Description: This routin helps user-level processes to write several buffers to a terminal device as one stream
+ *
+ *  Arguments:   array of buffer and length pairs, number of pairs, the unit number of the terminal, actual size that is written
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermWriteV(termIovec* iov, int count, int unit, int* sizeWritten)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMWRITEV;
+    sysArg.arg1     = iov;
+    sysArg.arg2     = (void *) ((long) count);
+    sysArg.arg3     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeWritten = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end TermWriteV */
+
+/*
+ *  Routine:    TermWriteUrgent
+ *
+ *  Description: This routin helps user-level processes to write a line to a terminal device ahead of ordinary output
+ *
+ *  Arguments:   buffer with the line, size of the line, the unit number of the terminal, actual size that is written
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermWriteUrgent(char* buf, int size, int unit, int* sizeWritten)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMWRITEURGENT;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) unit);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeWritten = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end TermWriteUrgent */
+
+/*
+ *  Routine:    PipeCreate
+ *
+ *  Description: This routin helps user-level processes to create a kernel pipe
+ *
+ *  Arguments:   bytes the pipe buffers, id of the new pipe
+ *
+ *  Return Value: -1 if the size is illegal or no pipe is free; 0 otherwise.
+ *
+ */
+int PipeCreate(int size, int* pipeID)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_PIPECREATE;
+    sysArg.arg1     = (void *) ((long) size);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *pipeID = (long) sysArg.arg1;
+    
+    return (long) sysArg.arg4;
+} /* end PipeCreate */
+
+/*
+ *  Routine:    PipeRead
+ *
+ *  Description: This routin helps user-level processes to read bytes from a pipe, waiting while it is empty
+ *
+ *  Arguments:   buffer to read into, size of the buffer, id of the pipe, actual size that is read
+ *
+ *  Return Value: -1 if illegal values are given as input or the pipe is closed while waiting; 0 otherwise.
+ *
+ */
+int PipeRead(char* buf, int size, int pipeID, int* sizeRead)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_PIPEREAD;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) pipeID);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeRead = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end PipeRead */
+
+/*
+ *  Routine:    PipeWrite
+ *
+ *  Description: This routin helps user-level processes to write bytes to a pipe, waiting while it is full
+ *
+ *  Arguments:   buffer with the bytes, number of bytes, id of the pipe, actual size that is written
+ *
+ *  Return Value: -1 if illegal values are given as input or the pipe is closed while waiting; 0 otherwise.
+ *
+ */
+int PipeWrite(char* buf, int size, int pipeID, int* sizeWritten)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_PIPEWRITE;
+    sysArg.arg1     = buf;
+    sysArg.arg2     = (void *) ((long) size);
+    sysArg.arg3     = (void *) ((long) pipeID);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    *sizeWritten = (long) sysArg.arg2;
+    
+    return (long) sysArg.arg4;
+} /* end PipeWrite */
+
+/*
+ *  Routine:    PipeClose
+ *
+ *  Description: This routin helps user-level processes to release a pipe so its id can be created again
+ *
+ *  Arguments:   id of the pipe
+ *
+ *  Return Value: -1 if the pipe is not open; 0 otherwise.
+ *
+ */
+int PipeClose(int pipeID)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_PIPECLOSE;
+    sysArg.arg1     = (void *) ((long) pipeID);
+    
+    USLOSS_Syscall(&sysArg);
+    
+    return (long) sysArg.arg4;
+} /* end PipeClose */
+
+/*
+ *  Routine:    TermStats
+ *
+ *  Description: This routin copies the traffic statistics of a terminal unit into stats.
+ *
+ *  Arguments:   the unit number of the terminal, address of a termStats structure to fill in
+ *
+ *  Return Value: -1 if illegal values are given as input; 0 otherwise.
+ *
+ */
+int TermStats(int unit, termStats *stats)
+{
+    systemArgs sysArg;
+    CHECKMODE;
+    
+    sysArg.number   = SYS_TERMSTATS;
+    sysArg.arg1     = (void *) ((long) unit);
+    sysArg.arg2     = stats;
+    
+    USLOSS_Syscall(&sysArg);
+    
+    return (long) sysArg.arg4;
+} /* end TermStats */
@@ -19,13 +19,39 @@ extern int  SemV(int semaphore);
 extern int  SemFree(int semaphore);
 
 // Phase 4 -- User Function Prototypes
+struct diskMirrorStats;
+struct termStats;
+struct termIovec;
+
 extern int  Sleep(int seconds);
 extern int  DiskRead(void *dbuff, int unit, int track, int first,
                      int sectors,int *status);
 extern int  DiskWrite(void *dbuff, int unit, int track, int first,
                       int sectors,int *status);
 extern int  DiskSize(int unit, int *sector, int *track, int *disk);
+extern int  DiskPread(void *buff, int unit, int offset, int length,
+                      int *status);
+extern int  DiskPwrite(void *buff, int unit, int offset, int length,
+                       int *status);
+extern int  DiskCopy(int srcUnit, int srcTrack, int srcFirst, int dstUnit,
+                     int dstTrack, int dstFirst, int sectors, int *status);
+extern int  DiskMirrorStats(struct diskMirrorStats *stats);
 extern int  TermRead(char *buff, int bsize, int unit_id, int *nread);
 extern int  TermWrite(char *buff, int bsize, int unit_id, int *nwrite);
+extern int  TermControl(int unit_id, int request, int value);
+extern int  TermSelect(int mask, int timeout, int *ready);
+extern int  TermTryRead(char *buff, int bsize, int unit_id, int *nread);
+extern int  TermTryWrite(char *buff, int bsize, int unit_id, int *nwrite);
+extern int  TermFlush(int unit_id);
+extern int  TermReadLines(char *buff, int bsize, int unit_id, int *lens,
+                          int maxlines, int *nlines);
+extern int  TermWriteV(struct termIovec *iov, int count, int unit_id,
+                       int *nwrite);
+extern int  TermWriteUrgent(char *buff, int bsize, int unit_id, int *nwrite);
+extern int  TermStats(int unit_id, struct termStats *stats);
+extern int  PipeCreate(int size, int *pipe_id);
+extern int  PipeRead(char *buff, int bsize, int pipe_id, int *nread);
+extern int  PipeWrite(char *buff, int bsize, int pipe_id, int *nwrite);
+extern int  PipeClose(int pipe_id);
 
 #endif
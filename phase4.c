@@ -6,6 +6,7 @@
 #include <phase4.h>
 #include <stdlib.h> /* needed for atoi() */
 #include <stdio.h>
+#include <string.h>
 #include <libuser.h>
 #include <providedPrototypes.h>
 
@@ -20,25 +21,67 @@ procPtr sleepList;
 int diskFinishFlag[USLOSS_DISK_UNITS];
 int diskTrack[USLOSS_DISK_UNITS]; // contains number of tracks per disk unit
 int diskMbox[USLOSS_DISK_UNITS];
-procPtr diskQueue[USLOSS_DISK_UNITS];
+diskReqPtr diskQueue[USLOSS_DISK_UNITS];
+int diskQueueLen[USLOSS_DISK_UNITS]; // number of requests waiting on each unit
+int diskHead[USLOSS_DISK_UNITS]; // track each disk head was last moved to
+
+diskReq diskReqPool[DISK_REQ_POOL]; // requests created by stacked devices
+diskReqPtr diskReqFree;
+
+// mirror structures
+diskMirrorStats mirrorStats;
+
+// ram disk structures
+char *ramDisk; // ramDiskTracks tracks of USLOSS_DISK_TRACK_SIZE sectors
+int ramDiskTracks;
 
 // term structures
-int lineBuffered[USLOSS_TERM_UNITS];
+byteRing termInput[USLOSS_TERM_UNITS]; // bytes of complete lines no reader has claimed yet
+byteRing termInputLens[USLOSS_TERM_UNITS]; // length of each line in termInput, oldest first
+int termInputSize;
+int termRecvOn[USLOSS_TERM_UNITS]; // receive interrupt enabled, off while termInput has no room for a line
+int termRaw[USLOSS_TERM_UNITS]; // raw mode, received bytes reach readers without line assembly
+int termRawMin[USLOSS_TERM_UNITS]; // bytes a raw TermRead waits for
+int termRawTime[USLOSS_TERM_UNITS]; // milliseconds a raw TermRead waits at most, 0 for no limit
+procPtr termReadWaiters[USLOSS_TERM_UNITS]; // readers blocked until the next line, oldest first
 int termDriverPID[USLOSS_TERM_UNITS];
-int termReaderPID[USLOSS_TERM_UNITS];
-int charinMbox[USLOSS_TERM_UNITS]; // to transfer status register
-int termReaderMbox[USLOSS_TERM_UNITS]; // to transfer one buffered line to termReadReal
-int termWriterPID[USLOSS_TERM_UNITS];
-int charoutMbox[USLOSS_TERM_UNITS]; // to transfer status register
-int termWriterPIDMbox[USLOSS_TERM_UNITS]; // to keep track of which user process is blocked
-int termWriterLineMbox[USLOSS_TERM_UNITS]; // to transfer the line to be written
+char termCurLine[USLOSS_TERM_UNITS][MAXLINE + 1]; // line being assembled by TermDriver
+int termCurLinePos[USLOSS_TERM_UNITS];
+byteRing xmitRing[USLOSS_TERM_UNITS]; // rest of the line being transmitted
+int termXmitSize[USLOSS_TERM_UNITS]; // size of the line being transmitted, -1 if none
+int termXmitPID[USLOSS_TERM_UNITS]; // writer of the line being transmitted, -1 if nobody waits for it
+char *termXmitBuf[USLOSS_TERM_UNITS]; // rest of a long write, still in the blocked writer's buffer
+int termXmitLeft[USLOSS_TERM_UNITS]; // bytes at termXmitBuf not yet moved to xmitRing
+termIovec *termXmitIov[USLOSS_TERM_UNITS]; // pieces of the write still to come after termXmitBuf
+int termXmitIovLeft[USLOSS_TERM_UNITS];
+int termXmitOn[USLOSS_TERM_UNITS]; // transmit interrupt enabled
+int termPollDepth[USLOSS_TERM_UNITS]; // queued records at which TermDriver polls, 0 for never
+int termPolling[USLOSS_TERM_UNITS]; // TermDriver is polling, transmit interrupts are off meanwhile
+termStats termStat[USLOSS_TERM_UNITS];
+int *termInputTimes[USLOSS_TERM_UNITS]; // when the first character of each line in termInput arrived, indexed like termInputLens
+int termCurLineTime[USLOSS_TERM_UNITS]; // when the first character of the line being assembled arrived
+int termXmitQueuedAt[USLOSS_TERM_UNITS]; // when the record being transmitted was queued
+int termWriteMbox[USLOSS_TERM_UNITS]; // termWriteReq records from any number of writers
+int termWritesQueued[USLOSS_TERM_UNITS]; // records sent to termWriteMbox and not yet taken
+termWriteReq termPending[USLOSS_TERM_UNITS][TERM_WRITE_SLOTS]; // records TermDriver took from termWriteMbox, oldest first
+int termPendingCount[USLOSS_TERM_UNITS];
+int termWriteBehind[USLOSS_TERM_UNITS]; // TermWrite returns once its data is queued
+int termCombine[USLOSS_TERM_UNITS]; // clock ticks an idle unit collects writes before transmitting, 0 for none
+int termCombineLeft[USLOSS_TERM_UNITS]; // ticks until the open combining window closes, 0 if none is open
+int termLoopPeer[USLOSS_TERM_UNITS]; // loopback, unit whose line discipline gets our output instead of the device, -1 if none
+procPtr termFlushWaiters[USLOSS_TERM_UNITS]; // processes in TermFlush until the unit's output drained
+procPtr termSelectWaiters; // processes blocked in TermSelect, on any unit
+
+// pipe structures
+int pipeUsed[MAXPIPES];
+byteRing pipeRing[MAXPIPES]; // bytes written that no reader took yet
+procPtr pipeReaders[MAXPIPES]; // readers blocked on an empty pipe, oldest first
+procPtr pipeWriters[MAXPIPES]; // writers blocked on a full pipe
 
 // driver processes
 static int ClockDriver(char *);
 static int DiskDriver(char *);
 static int TermDriver(char *);
-static int TermReader(char *);
-static int TermWriter(char *);
 
 // system helpers
 void sleep(systemArgs *);
@@ -47,13 +90,69 @@ void diskSize(systemArgs *);
 int diskSizeReal(int, int*, int*, int*);
 void diskWrite(systemArgs *);
 int diskWriteReal(char*, int, int, int, int, int*);
-int diskRequest(char*, int, int, int, int);
+void diskRequest(diskReqPtr, int, char*, int, int, int, int);
 void diskRead(systemArgs *);
 int diskReadReal(char*, int, int, int, int, int*);
+void diskMirrorStatsCall(systemArgs *);
+void diskPread(systemArgs *);
+int diskPreadReal(char*, int, int, int, int*);
+void diskPwrite(systemArgs *);
+int diskPwriteReal(char*, int, int, int, int*);
+int diskByteRequest(diskReqPtr, int, char*, int, int, int);
+void diskCopy(systemArgs *);
+int diskCopyReal(int, int, int, int, int, int, int, int*);
+void diskSectorRequest(diskReqPtr, int, char*, int, int, int);
 void termRead(systemArgs *);
 int termReadReal(char*, int, int, int*);
 void termWrite(systemArgs *);
 int termWriteReal(char*, int, int, int*);
+void termControl(systemArgs *);
+int termControlReal(int, int, int);
+void termSelect(systemArgs *);
+int termSelectReal(int, int, int*);
+void termTryRead(systemArgs *);
+int termTryReadReal(char*, int, int, int*);
+void termTryWrite(systemArgs *);
+int termTryWriteReal(char*, int, int, int*);
+void termFlush(systemArgs *);
+int termFlushReal(int);
+void termReadLines(systemArgs *);
+int termReadLinesReal(char*, int, int, int*, int, int*);
+void termWriteV(systemArgs *);
+int termWriteVReal(termIovec*, int, int, int*);
+void termWriteUrgent(systemArgs *);
+int termWriteUrgentReal(char*, int, int, int*);
+void termStatsCall(systemArgs *);
+void pipeCreate(systemArgs *);
+int pipeCreateReal(int, int*);
+void pipeRead(systemArgs *);
+int pipeReadReal(char*, int, int, int*);
+void pipeWrite(systemArgs *);
+int pipeWriteReal(char*, int, int, int*);
+void pipeClose(systemArgs *);
+int pipeCloseReal(int);
+
+// block devices
+blockDevOps *blockDev(int);
+int blockDevIO(int, diskReqPtr);
+int blockDevWait(int);
+int diskUnitValid(int);
+int diskUnitTracks(int);
+int physDiskSubmit(int, diskReqPtr);
+void physDiskComplete(diskReqPtr);
+int physDiskGeometry(int, int*, int*, int*);
+int physDiskFlush(int);
+int mirrorSubmit(int, diskReqPtr);
+int mirrorGeometry(int, int*, int*, int*);
+void mirrorSplit(int, diskReqPtr);
+int mirrorFlush(int);
+int mirrorPickUnit(int);
+int ramDiskSubmit(int, diskReqPtr);
+void ramDiskComplete(diskReqPtr);
+int ramDiskGeometry(int, int*, int*, int*);
+int ramDiskFlush(int);
+void ramDiskInit();
+void ramDiskTransfer(diskReqPtr);
 
 // kernel helpers
 void check_kernel_mode(char *);
@@ -64,9 +163,71 @@ void clearProcess(int);
 void printProcTable();
 void addSleepRequest(procPtr*, procPtr);
 void printSleepList();
-void addDiskRequest(procPtr*, procPtr);
-void printDiskReqQueue(procPtr*);
-void dequeueDiskReq(procPtr*);
+void addWaiter(procPtr*, procPtr);
+void disableInterrupts();
+void enableInterrupts();
+void addDiskRequest(diskReqPtr*, diskReqPtr);
+void printDiskReqQueue(diskReqPtr*);
+void dequeueDiskReq(diskReqPtr*);
+int diskSectorIO(int, int, int, char*);
+void initDiskReqPool();
+diskReqPtr allocDiskReq();
+void freeDiskReq(diskReqPtr);
+void termSetInterrupts(int);
+void termReceiveChar(int, char);
+void termLineDone(int, char*, int);
+int termTakeLine(int, char*, int);
+int termTakeBytes(int, char*, int);
+void termInputFreed(int);
+int termReadReady(int, int);
+void termRawDeliver(int);
+void termRawTimeouts();
+void termSetMode(int, int);
+int termSelectReady(int);
+void termSelectWake();
+void termSelectTimeouts();
+void termInputInit();
+void termTransmit(int);
+void termPollTransmit(int);
+void termXmitDone(int);
+void termInputWatch(int);
+void termLatency(int*, int);
+void termLoopPump(int);
+int termSetLoopback(int, int);
+int termNextLine(int);
+int termPickRecord(int);
+void termXmitFill(int);
+void termQueueBehind(int, char*, int);
+int termSendAndWait(int, termWriteReq*, int);
+void termKick(int);
+void termCombineTick();
+int termOutputIdle(int);
+void termFlushWake(int);
+void ringInit(byteRing*, int);
+int ringCount(byteRing*);
+int ringPut(byteRing*, char);
+char ringGet(byteRing*);
+char ringPeek(byteRing*);
+
+// backends of the block device layer
+blockDevOps physDiskOps = {
+    .submit     = physDiskSubmit,
+    .complete   = physDiskComplete,
+    .geometry   = physDiskGeometry,
+    .flush      = physDiskFlush,
+};
+blockDevOps mirrorOps = {
+    .submit     = mirrorSubmit,
+    .complete   = physDiskComplete, // both halves complete on a physical driver
+    .geometry   = mirrorGeometry,
+    .flush      = mirrorFlush,
+};
+blockDevOps ramDiskOps = {
+    .submit     = ramDiskSubmit,
+    .complete   = ramDiskComplete,
+    .geometry   = ramDiskGeometry,
+    .flush      = ramDiskFlush,
+};
 
 void start3(void)
 {
@@ -119,6 +280,8 @@ void start3(void)
         sprintf(buf, "%d", i);
         pid = fork1("Disk driver", DiskDriver, buf, USLOSS_MIN_STACK, 2);
         diskQueue[i] = NULL;
+        diskQueueLen[i] = 0;
+        diskHead[i] = 0;
         diskFinishFlag[i] = 0;
         if (pid < 0) {
             USLOSS_Console("start3(): Can't create term driver %d\n", i);
@@ -127,33 +290,68 @@ void start3(void)
     }
     sempReal(semRunning);
     sempReal(semRunning);
+    initDiskReqPool();
+    mirrorStats = (diskMirrorStats) {0};
+    ramDiskInit();
     /* --------------------------------------------DiskDriver(s) created */
     
     /*
      * Create terminal device drivers.
      */
+    termInputInit();
+    termSelectWaiters = NULL;
     for (i = 0; i < USLOSS_TERM_UNITS; i++)
     {
         sprintf(buf, "%d", i);
-        termDriverPID[i] = fork1("Term driver", TermDriver, buf, USLOSS_MIN_STACK, 2);
-        lineBuffered[i] = 0;
-        charinMbox[i] = MboxCreate(0, sizeof(int));
+        ringInit(&termInput[i], termInputSize);
+        ringInit(&termInputLens[i], termInputSize); // every line takes at least one byte
+        termInputTimes[i] = malloc(termInputSize * sizeof(int));
+        if (termInputTimes[i] == NULL)
+        {
+            USLOSS_Console("start3(): can't allocate line times of term %d. Halting...\n", i);
+            USLOSS_Halt(1);
+        }
+        termRecvOn[i] = 1;
+        termRaw[i] = 0;
+        termRawMin[i] = 1;
+        termRawTime[i] = 0;
+        termReadWaiters[i] = NULL;
+        memset(termCurLine[i], 0, MAXLINE + 1);
+        termCurLinePos[i] = 0;
+        ringInit(&xmitRing[i], TERM_XMIT_SIZE);
+        termXmitSize[i] = -1;
+        termXmitPID[i] = -1;
+        termXmitBuf[i] = NULL;
+        termXmitLeft[i] = 0;
+        termXmitIov[i] = NULL;
+        termXmitIovLeft[i] = 0;
+        termXmitOn[i] = 0;
+        termPollDepth[i] = TERM_POLL_DEPTH;
+        termPolling[i] = 0;
+        termStat[i] = (termStats) {0};
+        
+        // the mailboxes must exist before the driver takes its first interrupt
+        termWriteMbox[i] = MboxCreate(TERM_WRITE_SLOTS, sizeof(termWriteReq));
+        termWritesQueued[i] = 0;
+        termPendingCount[i] = 0;
+        termWriteBehind[i] = 0;
+        termCombine[i] = 0;
+        termCombineLeft[i] = 0;
+        termLoopPeer[i] = -1;
+        termFlushWaiters[i] = NULL;
         
         if (debugflag4)
-            USLOSS_Console("\tcreated mail box for term unit %d, with id of %d\n", i, charinMbox[i]);
-        
-        termReaderMbox[i] = MboxCreate(10, sizeof(char) * MAXLINE + 1);
-        termReaderPID[i] = fork1("Term reader", TermReader, buf, USLOSS_MIN_STACK, 2);
-        charoutMbox[i] = MboxCreate(0, sizeof(int));
-        termWriterPID[i] = fork1("Term writer", TermWriter, buf, USLOSS_MIN_STACK, 2);
-        termWriterPIDMbox[i] = MboxCreate(1, sizeof(int));
-        termWriterLineMbox[i] = MboxCreate(10, sizeof(char) * MAXLINE + 1);
-        sempReal(semRunning);
-        sempReal(semRunning);
+            USLOSS_Console("\tcreated mail boxes for term unit %d, writer %d\n", i, termWriteMbox[i]);
+        
+        termDriverPID[i] = fork1("Term driver", TermDriver, buf, USLOSS_MIN_STACK, 2);
         sempReal(semRunning);
     }
     /* --------------------------------------------TerminalDriver(s) created */
     
+    // pipes get their buffer when they are created
+    for (i = 0; i < MAXPIPES; i++)
+        pipeUsed[i] = 0;
+    
     
     /*
      * Create first user-level process and wait for it to finish.
@@ -174,7 +372,9 @@ void start3(void)
     zap(clockPID);  // clock driver
     join(&status);
     
-    // quit disk drivers
+    // quit disk drivers, after the stacked devices handed down anything they hold
+    blockDev(DISK_MIRROR_UNIT)->flush(DISK_MIRROR_UNIT);
+    blockDev(DISK_RAM_UNIT)->flush(DISK_RAM_UNIT);
     for (i = 0; i < USLOSS_DISK_UNITS; i++)
     {
         diskFinishFlag[i] = 1;
@@ -186,10 +386,10 @@ void start3(void)
     char filename[20]; // a buffer to store terminal file names
     for (i = 0; i < USLOSS_TERM_UNITS; i++)
     {
-        // wake up term driver one more time
-        int ctrl = 0;
-        ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, i, (void *)((long) ctrl));
+        // wake up term driver one more time, even if its input buffer is full or it is looped
+        termLoopPeer[i] = -1;
+        termRecvOn[i] = 1;
+        termSetInterrupts(i);
         
         // update the terminal file in order to quit USLOSS
         sprintf(filename, "term%d.in", i);
@@ -202,15 +402,8 @@ void start3(void)
         zap(termDriverPID[i]);
         join(&status);
         
-        // zap term reader and join it
-        MboxSend(charinMbox[i], NULL, 0);
-        zap(termReaderPID[i]);
-        join(&status);
-        
-        // zap term writer and join it
-        MboxSend(termWriterLineMbox[i], NULL, 0);
-        zap(termWriterPID[i]);
-        join(&status);
+        if (debugflag4)
+            USLOSS_Console("\tterm %d: %d driver wakeups, %d polled chars, %d lines in, %d lines out, %d drops\n", i, termStat[i].wakeups, termStat[i].polledChars, termStat[i].linesIn, termStat[i].linesOut, termStat[i].drops);
     }
     /* end of zapping device drivers */
     
@@ -255,6 +448,13 @@ static int ClockDriver(char *arg)
             MboxCondSend(sleepList->privateMboxID, 0, 0);
             sleepList = sleepList->nextSleepPtr;
         }
+        
+        // give raw readers and TermSelect callers whose timer ran out what there is
+        disableInterrupts();
+        termRawTimeouts();
+        termSelectTimeouts();
+        termCombineTick();
+        enableInterrupts();
     }
     
     procPtr proc = sleepList;
@@ -274,6 +474,7 @@ static int DiskDriver(char *arg)
      */
     int unit = atoi( (char *) arg); 	// Unit is passed as arg.
     int status;
+    char sectorBuf[USLOSS_DISK_SECTOR_SIZE]; // staging area for partial sectors
     
     // update size of disk track
     USLOSS_DeviceRequest req = (USLOSS_DeviceRequest){
@@ -307,76 +508,103 @@ static int DiskDriver(char *arg)
         }
         
         
-        // get the head request
-        procPtr headReq = diskQueue[unit];
-        
-        if (debugflag4 || diskDebug)
-            USLOSS_Console("DiskDriver(): disk %d woke up\n\t going to %s track %d requested by process %d\n", unit, headReq->opr == USLOSS_DISK_WRITE ? "write" : "read", headReq->track, headReq->pid);
-        
-        
-        // move to the right track
-        USLOSS_DeviceRequest req;
-        req.opr = USLOSS_DISK_SEEK;
-        req.reg1 = (void*)(long)headReq->track;
-        USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req);
-        waitDevice(USLOSS_DISK_DEV, unit, &status);
-        
-        // start to read or write
-        int sectorCounter = headReq->sectors;
-        int currSector = headReq->first;
-        int currTrack = headReq->track;
-        char* buf = headReq->buf;
-        while (sectorCounter > 0)
+        // serve everything queued so far, a whole batch wakes us only once
+        while (diskQueue[unit] != NULL)
         {
-            req.opr = headReq->opr;
-            req.reg1 = (void*)(long)currSector;
-            req.reg2 = (void*)(long)buf;
+            // get the head request
+            diskReqPtr headReq = diskQueue[unit];
+            
+            if (debugflag4 || diskDebug)
+                USLOSS_Console("DiskDriver(): disk %d serving\n\t going to %s track %d requested by process %d\n", unit, headReq->opr == USLOSS_DISK_WRITE ? "write" : "read", headReq->track, headReq->pid);
+            
+            
+            // move to the right track
+            USLOSS_DeviceRequest req;
+            req.opr = USLOSS_DISK_SEEK;
+            req.reg1 = (void*)(long)headReq->track;
             USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req);
             waitDevice(USLOSS_DISK_DEV, unit, &status);
+            diskHead[unit] = headReq->track;
             
-            currSector++;
-            
-            // track wrap around
-            if(currSector >= diskTrack[unit]){
-                if (debugflag4)
-                    USLOSS_Console("DiskDriver(): wrapped around\n");
-                currSector = 0;
-                currTrack = (currTrack + 1) % diskTrack[unit];
+            // start to read or write
+            int sectorCounter = headReq->sectors;
+            int currSector = headReq->first;
+            int currTrack = headReq->track;
+            char* buf = headReq->buf;
+            int skip = headReq->offset; // bytes of the current sector left untouched
+            int remaining = headReq->length;
+            while (sectorCounter > 0)
+            {
+                int chunk = USLOSS_DISK_SECTOR_SIZE - skip;
+                if (chunk > remaining)
+                    chunk = remaining;
+                
+                // whole sectors move straight between the device and buf
+                if (chunk == USLOSS_DISK_SECTOR_SIZE)
+                    status = diskSectorIO(unit, headReq->opr, currSector, buf);
+                // partial sectors go through sectorBuf, nobody else can touch the sector in between
+                else
+                {
+                    status = diskSectorIO(unit, USLOSS_DISK_READ, currSector, sectorBuf);
+                    if (headReq->opr == USLOSS_DISK_READ)
+                        memcpy(buf, sectorBuf + skip, chunk);
+                    else if (status != USLOSS_DEV_ERROR)
+                    {
+                        memcpy(sectorBuf + skip, buf, chunk);
+                        status = diskSectorIO(unit, USLOSS_DISK_WRITE, currSector, sectorBuf);
+                    }
+                }
+                if (status == USLOSS_DEV_ERROR)
+                    headReq->status = status;
+                
+                currSector++;
+                
+                // track wrap around
+                if(currSector >= USLOSS_DISK_TRACK_SIZE){
+                    if (debugflag4)
+                        USLOSS_Console("DiskDriver(): wrapped around\n");
+                    currSector = 0;
+                    currTrack = (currTrack + 1) % diskTrack[unit];
+                    
+                    // move to next track
+                    req.opr = USLOSS_DISK_SEEK;
+                    req.reg1 = (void*)(long)currTrack;
+                    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req);
+                    waitDevice(USLOSS_DISK_DEV, unit, &status);
+                    diskHead[unit] = currTrack;
+                }
+                
+                // move pointer in buf
+                buf += chunk;
+                remaining -= chunk;
+                skip = 0;
                 
-                // move to next track
-                req.opr = USLOSS_DISK_SEEK;
-                req.reg1 = (void*)(long)currTrack;
-                USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req);
-                waitDevice(USLOSS_DISK_DEV, unit, &status);
+                sectorCounter--;
             }
             
-            // move pointer in buf
-            buf += USLOSS_DISK_SECTOR_SIZE;
+            if (debugflag4 || diskDebug)
+                USLOSS_Console("DiskDriver(): request on track %d by process %d completed\n", headReq->track, headReq->pid);
             
-            sectorCounter--;
-        }
-        
-        if (debugflag4 || diskDebug)
-            USLOSS_Console("DiskDriver(): request on track %d by process %d completed\n", headReq->track, headReq->pid);
-        
-        // move headReq to next request
-        dequeueDiskReq(&diskQueue[unit]);
-        
-        if (debugflag4 || diskDebug)
-        {
-            USLOSS_Console("\tafter dequeue, new list is\n");
-            printDiskReqQueue(&diskQueue[unit]);
+            // move headReq to next request
+            dequeueDiskReq(&diskQueue[unit]);
+            diskQueueLen[unit]--;
+            
+            if (debugflag4 || diskDebug)
+            {
+                USLOSS_Console("\tafter dequeue, new list is\n");
+                printDiskReqQueue(&diskQueue[unit]);
+            }
+            
+            // unblock waiting user-level process
+            blockDev(unit)->complete(headReq);
         }
-        
-        // unblock waiting user-level process
-        MboxSend(headReq->privateMboxID, NULL, 0);
-        
     }
     
     return unit;
 } /* end of DiskDriver */
 
 /* ------------------------- TermDriver ----------------------------------- */
+// purpose: the only kernel process of a terminal unit, assembles received lines and transmits written ones
 static int TermDriver(char *arg)
 {
     int unit = atoi((char *) arg);
@@ -388,14 +616,13 @@ static int TermDriver(char *arg)
     
     
     // set the recv int enable bit for all the terminals and leave them on
-    int ctrl = 0;
-    ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-    result = USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *)((long) ctrl));
+    termSetInterrupts(unit);
     
     // begin its service
     while (!isZapped())
     {
         result = waitDevice(USLOSS_TERM_DEV, unit, &status);
+        termStat[unit].wakeups++;
         
         if (debugflag4)
             USLOSS_Console("\tTermDriver(): woke up.\n");
@@ -403,167 +630,37 @@ static int TermDriver(char *arg)
         if (result != 0)
             return 0;
         
-        // unblocked by TermRead
+        // a character arrived
         if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_BUSY)
         {
             if (debugflag4)
                 USLOSS_Console("\tTermDriver(): device %d received status of dev busy\n", unit);
             
-            MboxSend(charinMbox[unit], &status, sizeof(int));
-            
-            if (debugflag4)
-                USLOSS_Console("\tTermDriver(): sent a status reg to mailbox %d\n", charinMbox[unit]);
-        }
-        if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY)
-        {
-            MboxCondSend(charoutMbox[unit], &status, sizeof(int));
-        }
-    }
-    
-    return 0;
-} /* end of TermDriver */
-
-/* ------------------------- TermReader ----------------------------------- */
-static int TermReader(char *arg)
-{
-    int unit = atoi((char *) arg);
-    
-    int statReg;
-    char curLine[MAXLINE + 1];
-    int curLinePos = 0;
-    
-    int i;
-    for (i = 0; i < MAXLINE + 1; i++)
-    {
-        curLine[i] = '\0';
-    }
-    
-    semvReal(semRunning);
-    // end of initialization
-    
-    // begin its service
-    while (!isZapped())
-    {
-        MboxReceive(charinMbox[unit], &statReg, sizeof(int));
-        
-        // get char received
-        char received = USLOSS_TERM_STAT_CHAR(statReg);
-        
-        if (debugflag4)
-            USLOSS_Console("\t\tTermReader(): unit %d received character '%c'\n", unit, received);
-        
-        // reaches MAXLINE
-        if (curLinePos == MAXLINE)
-        {
-            // finish up the current line
-            curLine[curLinePos] = '\0';
-            
-            if (debugflag4)
-                USLOSS_Console("\t\tTermReader(): unit %d sending an incomplete line\n", unit);
-            lineBuffered[unit]++;
-            MboxCondSend(termReaderMbox[unit], &curLine, MAXLINE);
-            
-            // wipe out current line to get ready for next line
-            curLinePos = 0;
-            for (i = 0; i < MAXLINE + 1; i++){
-                curLine[i] = '\0';
+            // a looped unit takes its input from its peer, not from the device
+            disableInterrupts();
+            if (termLoopPeer[unit] < 0)
+            {
+                termStat[unit].bytesIn++;
+                termReceiveChar(unit, USLOSS_TERM_STAT_CHAR(status));
             }
-            
-            // put received char to a new line
-            curLine[curLinePos] = received;
-            curLinePos++;
+            enableInterrupts();
         }
-        // reaches a newline
-        else if (received == '\n')
+        // only while we asked for transmit interrupts, a received character shows the transmitter
+        // ready too, and a looped unit sends its output to its peer, never to the device
+        if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY && termXmitOn[unit] && termLoopPeer[unit] < 0)
         {
-            // finish up the current line
-            curLine[curLinePos] = received;
-            
-            if (debugflag4)
-                USLOSS_Console("\t\tTermReader(): unit %d sending a complete line:\n%s\n", unit, curLine);
-            lineBuffered[unit]++;
-            MboxCondSend(termReaderMbox[unit], &curLine, MAXLINE);
-            
-            // wipe out current line to get ready for next line
-            curLinePos = 0;
-            for (i = 0; i < MAXLINE + 1; i++){
-                curLine[i] = '\0';
+            // the status may be a stale one queued before polling sent more characters
+            USLOSS_DeviceInput(USLOSS_TERM_DEV, unit, &status);
+            if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY)
+            {
+                termTransmit(unit);
+                termPollTransmit(unit);
             }
-            
-        }
-        // normal cases
-        else
-        {
-            curLine[curLinePos] = received;
-            curLinePos++;
-        }
-    }
-    
-    return 0;
-} /* end of TermReader */
-
-/* ------------------------- TermWriter ----------------------------------- */
-static int TermWriter(char *arg)
-{
-    int unit = atoi((char *) arg);
-    
-    char result[MAXLINE + 1];
-    semvReal(semRunning);
-    // end of initialization
-    
-    // begin its service
-    while (!isZapped())
-    {
-        // get the line to be written
-        int sizeToWrite = MboxReceive(termWriterLineMbox[unit], result, MAXLINE + 1);
-        
-        if (isZapped())
-            break;
-        
-        if (debugflag4)
-            USLOSS_Console("\tTermWriter(): going to write line size %d:\n\t\t%s", sizeToWrite, result);
-        
-        // turn on transmit bit
-        int ctrl = 0;
-        ctrl = USLOSS_TERM_CTRL_XMIT_INT((long)ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*) ((long)ctrl));
-        
-        // write line char by char
-        int i = 0;
-        int status = 0;
-        while (sizeToWrite > i)
-        {
-            MboxReceive(charoutMbox[unit], &status, sizeof(int));
-            
-            ctrl = 0;
-            ctrl =  USLOSS_TERM_CTRL_CHAR(ctrl, result[i]);
-            ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
-            ctrl =  USLOSS_TERM_CTRL_XMIT_CHAR(ctrl);
-            
-            USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*) ((long)ctrl));
-            
-            i++;
-            
         }
-        
-        // write the last char
-        ctrl = 0;
-        ctrl =  USLOSS_TERM_CTRL_CHAR(ctrl, result[i]);
-        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
-        ctrl =  USLOSS_TERM_CTRL_XMIT_CHAR(ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*) ((long)ctrl));
-        
-        // get which process to unblock
-        int pid = -1;
-        MboxReceive(termWriterPIDMbox[unit], &pid, sizeof(int));
-        
-        // unblock invoking process
-        MboxSend(ProcTable[pid % MAXPROC].privateMboxID, &sizeToWrite, sizeof(int));
-        
     }
     
     return 0;
-} /* end of TermWriter */
+} /* end of TermDriver */
 
 
 
@@ -644,14 +741,10 @@ void diskSize(systemArgs *sysArg)
 /* ------------------------- diskSizeReal ----------------------------------- */
 int diskSizeReal(int unit, int* sector, int* track, int* disk)
 {
-    if (unit < 0 || unit >= USLOSS_DISK_UNITS)
+    if (!diskUnitValid(unit))
         return -1;
     
-    *sector = USLOSS_DISK_SECTOR_SIZE;
-    *track = USLOSS_DISK_TRACK_SIZE;
-    *disk = diskTrack[unit];
-    
-    return 0;
+    return blockDev(unit)->geometry(unit, sector, track, disk);
     
 } /* end of diskSizeReal */
 
@@ -676,36 +769,23 @@ void diskWrite(systemArgs *sysArg)
 } /* end of diskWrite */
 
 /* ------------------------- diskWriteReal ----------------------------------- */
-// purpose: call diskRequest to put new disk request on queue, wake up DiskDriver before blocking whichever user-level process that calls DiskWrite and wait till DiskDriver to finish this request
+// purpose: call diskRequest to build the disk request, hand it to the unit's block device and block whichever user-level process that calls DiskWrite till the device finishes this request
 int diskWriteReal(char* writeBuf, int sectors, int track, int first, int unit, int* status)
 {
     // handle illegal input
-    if (unit < 0 || unit >= USLOSS_DISK_UNITS)
+    if (!diskUnitValid(unit))
         return -1;
-    if (sectors < 0 || track < 0 || track >= diskTrack[unit] || first >= USLOSS_DISK_TRACK_SIZE)
+    if (sectors < 0 || track < 0 || track >= diskUnitTracks(unit) || first >= USLOSS_DISK_TRACK_SIZE)
         return -1;
     
-    
-    
-    // put request on queue
-    ProcTable[getpid() % MAXPROC].opr = USLOSS_DISK_WRITE;
-    diskRequest(writeBuf, sectors, track, first, unit);
-    
-    if (debugflag4 || diskDebug)
-    {
-        USLOSS_Console("\tdiskWriteReal(): after process %d's request received\n", getpid());
-        printDiskReqQueue(&diskQueue[unit]);
-        USLOSS_Console("\tdiskWriteReal(): process %d unblocking DeviceDriver %d\n", getpid(), unit);
-    }
-    
-    // wake up disk driver
-    MboxSend(diskMbox[unit], NULL, 0);
+    diskReq req;
+    diskRequest(&req, USLOSS_DISK_WRITE, writeBuf, sectors, track, first, unit);
     
     if (debugflag4 || diskDebug)
-        USLOSS_Console("\tdiskWriteReal(): blocking pid %d\n", getpid());
+        USLOSS_Console("\tdiskWriteReal(): process %d submitting to unit %d\n", getpid(), unit);
     
     // block current running user-level process
-    MboxReceive(ProcTable[getpid() % MAXPROC].privateMboxID, 0, 0);
+    *status = blockDevIO(unit, &req);
     
     if (debugflag4 || diskDebug)
         USLOSS_Console("\tdiskWriteReal(): process %d's request on track %d finished\n", getpid(), track);
@@ -714,28 +794,26 @@ int diskWriteReal(char* writeBuf, int sectors, int track, int first, int unit, i
 } /* end of diskWriteReal */
 
 /* ------------------------- diskRequest ----------------------------------- */
-// purpose: log new disk request process in procTable4, call addDiskRequest to put new request on disk's queue
-int diskRequest(char* buf, int sectors, int track, int first, int unit)
+// purpose: fill in a new disk request of the current process, its completion goes to the process's private mailbox
+void diskRequest(diskReqPtr newDisk, int opr, char* buf, int sectors, int track, int first, int unit)
 {
     if (debugflag4)
         USLOSS_Console("diskRequest(): enetered\n");
     
-    int status = 0;
-    
-    // construct new disk request process
-    procPtr newDisk = &ProcTable[getpid() % MAXPROC];
-    newDisk->nextDiskPtr    = NULL;
     newDisk->pid            = getpid();
+    newDisk->opr            = opr;
     newDisk->buf            = buf;
     newDisk->sectors        = sectors;
     newDisk->track          = track;
     newDisk->first          = first;
+    newDisk->offset         = 0;
+    newDisk->length         = sectors * USLOSS_DISK_SECTOR_SIZE;
     newDisk->unit           = unit;
-    
-    // put request on queue
-    addDiskRequest(&diskQueue[unit], newDisk);
-    
-    return status;
+    newDisk->status         = 0;
+    newDisk->doneMboxID     = ProcTable[getpid() % MAXPROC].privateMboxID;
+    newDisk->pooled         = 0;
+    newDisk->next           = NULL;
+    newDisk->nextDiskPtr    = NULL;
 } /* end of diskRequest */
 
 /* ------------------------- diskRead ----------------------------------- */
@@ -762,23 +840,221 @@ void diskRead(systemArgs *sysArg)
 int diskReadReal(char* readBuf, int sectors, int track, int first, int unit, int* status)
 {
     // handle illegal input
-    if (unit < 0 || unit >= USLOSS_DISK_UNITS)
+    if (!diskUnitValid(unit))
         return -1;
-    if (sectors < 0 || track < 0 || track >= USLOSS_DISK_TRACK_SIZE)
+    if (sectors < 0 || track < 0 || track >= diskUnitTracks(unit) || first >= USLOSS_DISK_TRACK_SIZE)
         return -1;
     
-    // put request on queue
-    ProcTable[getpid() % MAXPROC].opr = USLOSS_DISK_READ;
-    *status = diskRequest(readBuf, sectors, track, first, unit);
-    
-    // wake up disk driver
-    MboxSend(diskMbox[unit], NULL, 0);
+    diskReq req;
+    diskRequest(&req, USLOSS_DISK_READ, readBuf, sectors, track, first, unit);
     
     // block current running user-level process
-    MboxReceive(ProcTable[getpid() % MAXPROC].privateMboxID, 0, 0);
+    *status = blockDevIO(unit, &req);
     
     return 0;
-} /* end of diskWriteReal */
+} /* end of diskReadReal */
+
+/* ------------------------- diskMirrorStatsCall ----------------------------------- */
+void diskMirrorStatsCall(systemArgs *sysArg)
+{
+    diskMirrorStats *stats = sysArg->arg1;
+    
+    if (stats == NULL)
+        sysArg->arg4 = (void *) -1L;
+    else
+    {
+        *stats = mirrorStats;
+        sysArg->arg4 = (void *) 0L;
+    }
+    
+    setUserMode();
+} /* end of diskMirrorStatsCall */
+
+/* ------------------------- diskPread ----------------------------------- */
+void diskPread(systemArgs *sysArg)
+{
+    char* readBuf = sysArg->arg1;
+    int length  = (long)sysArg->arg2;
+    int offset  = (long)sysArg->arg3;
+    int unit    = (long)sysArg->arg5;
+    
+    if (debugflag4)
+        USLOSS_Console("diskPread(): reading %d bytes at offset %d of unit %d\n", length, offset, unit);
+    
+    int status = 0; // 0 if transfer was sucessful; the disk status register otherwise
+    int readResult = diskPreadReal(readBuf, length, offset, unit, &status);
+    
+    sysArg->arg1 = (void *) ((long)status);
+    sysArg->arg4 = (void *) ((long)readResult);
+    
+    setUserMode();
+} /* end of diskPread */
+
+/* ------------------------- diskPreadReal ----------------------------------- */
+int diskPreadReal(char* readBuf, int length, int offset, int unit, int* status)
+{
+    diskReq req;
+    
+    if (diskByteRequest(&req, USLOSS_DISK_READ, readBuf, length, offset, unit) < 0)
+        return -1;
+    
+    if (length > 0)
+        *status = blockDevIO(unit, &req);
+    
+    return 0;
+} /* end of diskPreadReal */
+
+/* ------------------------- diskPwrite ----------------------------------- */
+void diskPwrite(systemArgs *sysArg)
+{
+    char* writeBuf = sysArg->arg1;
+    int length  = (long)sysArg->arg2;
+    int offset  = (long)sysArg->arg3;
+    int unit    = (long)sysArg->arg5;
+    
+    if (debugflag4)
+        USLOSS_Console("diskPwrite(): writing %d bytes at offset %d of unit %d\n", length, offset, unit);
+    
+    int status = 0; // 0 if transfer was sucessful; the disk status register otherwise
+    int writeResult = diskPwriteReal(writeBuf, length, offset, unit, &status);
+    
+    sysArg->arg1 = (void *) ((long)status);
+    sysArg->arg4 = (void *) ((long)writeResult);
+    
+    setUserMode();
+} /* end of diskPwrite */
+
+/* ------------------------- diskPwriteReal ----------------------------------- */
+// purpose: the driver read-modify-writes partial sectors within a single queue visit, so concurrent small updates of one sector cannot lose each other
+int diskPwriteReal(char* writeBuf, int length, int offset, int unit, int* status)
+{
+    diskReq req;
+    
+    if (diskByteRequest(&req, USLOSS_DISK_WRITE, writeBuf, length, offset, unit) < 0)
+        return -1;
+    
+    if (length > 0)
+        *status = blockDevIO(unit, &req);
+    
+    return 0;
+} /* end of diskPwriteReal */
+
+/* ------------------------- diskByteRequest ----------------------------------- */
+// purpose: fill in a request for length bytes at byte offset of unit, -1 if the range is not on the disk
+int diskByteRequest(diskReqPtr newDisk, int opr, char* buf, int length, int offset, int unit)
+{
+    if (!diskUnitValid(unit) || length < 0 || offset < 0)
+        return -1;
+    
+    long diskBytes = (long)diskUnitTracks(unit) * USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE;
+    if ((long)offset + length > diskBytes)
+        return -1;
+    
+    int sector = offset / USLOSS_DISK_SECTOR_SIZE;
+    int skip = offset % USLOSS_DISK_SECTOR_SIZE;
+    int sectors = (skip + length + USLOSS_DISK_SECTOR_SIZE - 1) / USLOSS_DISK_SECTOR_SIZE;
+    
+    diskRequest(newDisk, opr, buf, sectors, sector / USLOSS_DISK_TRACK_SIZE, sector % USLOSS_DISK_TRACK_SIZE, unit);
+    newDisk->offset = skip;
+    newDisk->length = length;
+    
+    return 0;
+} /* end of diskByteRequest */
+
+/* ------------------------- diskCopy ----------------------------------- */
+void diskCopy(systemArgs *sysArg)
+{
+    int srcUnit     = (long)sysArg->arg1;
+    int srcSector   = (long)sysArg->arg2;
+    int dstUnit     = (long)sysArg->arg3;
+    int dstSector   = (long)sysArg->arg4;
+    int sectors     = (long)sysArg->arg5;
+    
+    if (debugflag4)
+        USLOSS_Console("diskCopy(): copying %d sector(s) from unit %d sector %d to unit %d sector %d\n", sectors, srcUnit, srcSector, dstUnit, dstSector);
+    
+    int status = 0; // 0 if transfer was sucessful; the disk status register otherwise
+    int copyResult = -1;
+    if (srcSector >= 0 && dstSector >= 0)
+        copyResult = diskCopyReal(srcUnit, srcSector / USLOSS_DISK_TRACK_SIZE, srcSector % USLOSS_DISK_TRACK_SIZE,
+                                  dstUnit, dstSector / USLOSS_DISK_TRACK_SIZE, dstSector % USLOSS_DISK_TRACK_SIZE,
+                                  sectors, &status);
+    
+    sysArg->arg1 = (void *) ((long)status);
+    sysArg->arg4 = (void *) ((long)copyResult);
+    
+    setUserMode();
+} /* end of diskCopy */
+
+/* ------------------------- diskCopyReal ----------------------------------- */
+// purpose: copy sectors through two kernel staging buffers, the write of one chunk runs together with the read of the next so both drivers stay busy
+int diskCopyReal(int srcUnit, int srcTrack, int srcFirst, int dstUnit, int dstTrack, int dstFirst, int sectors, int* status)
+{
+    // handle illegal input
+    if (!diskUnitValid(srcUnit) || !diskUnitValid(dstUnit) || sectors < 0)
+        return -1;
+    if (srcTrack < 0 || srcTrack >= diskUnitTracks(srcUnit) || srcFirst < 0 || srcFirst >= USLOSS_DISK_TRACK_SIZE)
+        return -1;
+    if (dstTrack < 0 || dstTrack >= diskUnitTracks(dstUnit) || dstFirst < 0 || dstFirst >= USLOSS_DISK_TRACK_SIZE)
+        return -1;
+    
+    int src = srcTrack * USLOSS_DISK_TRACK_SIZE + srcFirst;
+    int dst = dstTrack * USLOSS_DISK_TRACK_SIZE + dstFirst;
+    
+    // copying forward would overwrite source sectors before they are read
+    if (srcUnit == dstUnit && dst > src && dst < src + sectors)
+        return -1;
+    if (sectors == 0)
+        return 0;
+    
+    char *stage[2];
+    stage[0] = malloc(2 * DISK_COPY_CHUNK * USLOSS_DISK_SECTOR_SIZE);
+    if (stage[0] == NULL)
+        return -1;
+    stage[1] = stage[0] + DISK_COPY_CHUNK * USLOSS_DISK_SECTOR_SIZE;
+    
+    diskReq readReq, writeReq;
+    int done = 0;
+    int chunk = sectors < DISK_COPY_CHUNK ? sectors : DISK_COPY_CHUNK;
+    int k = 0;
+    
+    // prime the pipeline with the first chunk
+    diskSectorRequest(&readReq, USLOSS_DISK_READ, stage[0], chunk, src, srcUnit);
+    *status = blockDevIO(srcUnit, &readReq);
+    
+    while (*status == 0 && done < sectors)
+    {
+        int next = sectors - done - chunk;
+        if (next > DISK_COPY_CHUNK)
+            next = DISK_COPY_CHUNK;
+        
+        diskSectorRequest(&writeReq, USLOSS_DISK_WRITE, stage[k % 2], chunk, dst + done, dstUnit);
+        int pending = blockDev(dstUnit)->submit(dstUnit, &writeReq);
+        if (next > 0)
+        {
+            diskSectorRequest(&readReq, USLOSS_DISK_READ, stage[(k + 1) % 2], next, src + done + chunk, srcUnit);
+            pending += blockDev(srcUnit)->submit(srcUnit, &readReq);
+        }
+        *status = blockDevWait(pending);
+        
+        done += chunk;
+        chunk = next;
+        k++;
+    }
+    
+    free(stage[0]);
+    
+    return 0;
+} /* end of diskCopyReal */
+
+/* ------------------------- diskSectorRequest ----------------------------------- */
+// purpose: fill in a request addressed by sector number from the start of the disk, wrapping around at its end
+void diskSectorRequest(diskReqPtr newDisk, int opr, char* buf, int sectors, int sector, int unit)
+{
+    sector %= diskUnitTracks(unit) * USLOSS_DISK_TRACK_SIZE;
+    
+    diskRequest(newDisk, opr, buf, sectors, sector / USLOSS_DISK_TRACK_SIZE, sector % USLOSS_DISK_TRACK_SIZE, unit);
+} /* end of diskSectorRequest */
 
 /* ------------------------- termRead ----------------------------------- */
 void termRead(systemArgs* sysArg)
@@ -806,34 +1082,45 @@ int termReadReal(char* buf, int size, int unit, int* sizeRead)
     if (size < 0 || size > MAXLINE || unit < 0 || unit >= USLOSS_TERM_UNITS)
         return -1;
     
-    // storage place to receive from TermReader
-    char recBuf[MAXLINE];
+    procPtr reader = &ProcTable[getpid() % MAXPROC];
     
     // wake up TermDriver
-    int ctrl = 0;
-    ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-    USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *)((long)ctrl));
+    termSetInterrupts(unit);
     
     if (debugflag4)
         USLOSS_Console("\ttermReadReal(): going to read term %d, %d bytes\n", unit, size);
     
-    // block on TermReaderMbox
-    MboxReceive(termReaderMbox[unit], recBuf, MAXLINE);
+    // take buffered input, or queue up, before TermDriver can deliver more
+    disableInterrupts();
+    if (termReadReady(unit, size))
+    {
+        if (termRaw[unit])
+            *sizeRead = termTakeBytes(unit, buf, size);
+        else
+            *sizeRead = termTakeLine(unit, buf, size);
+        enableInterrupts();
+        
+        if (debugflag4)
+            USLOSS_Console("\ttermReadReal(): unit %d received buffered input:\n\t\t%.*s", unit, *sizeRead, buf);
+        
+        return 0;
+    }
+    reader->pid = getpid();
+    reader->waitBuf = buf;
+    reader->waitSize = size;
+    reader->wakeTime = 0;
+    if (termRaw[unit] && termRawTime[unit] > 0)
+        reader->wakeTime = USLOSS_Clock() + 1000 * termRawTime[unit];
+    addWaiter(&termReadWaiters[unit], reader);
+    enableInterrupts();
+    
+    // TermDriver copies the input straight into buf
+    MboxReceive(reader->waitMboxID, NULL, 0);
     
     if (debugflag4)
-        USLOSS_Console("\ttermReadReal(): unit %d received a line:\n\t\t%s", unit, recBuf);
+        USLOSS_Console("\ttermReadReal(): unit %d was handed input:\n\t\t%.*s", unit, reader->waitSize, buf);
     
-    // decrement line buffered
-    lineBuffered[unit]--;
-    
-    // transfer received line to char* buf char by char
-    int i = 0;
-    while (recBuf[i] != '\0' && i < size)
-    {
-        buf[i] = recBuf[i];
-        i++;
-    }
-    *sizeRead = i;
+    *sizeRead = reader->waitSize;
     
     return 0;
 }
@@ -852,256 +1139,2208 @@ void termWrite(systemArgs* sysArg)
     sysArg->arg4 = (void *) ((long)termResult);
 } /* end of termWrite */
 
-/* ------------------------- termWriteReal ----------------------------------- */
-int termWriteReal(char* buf, int size, int unit, int* sizeWritten)
+/* ------------------------- termControl ----------------------------------- */
+void termControl(systemArgs* sysArg)
 {
-    // check illegal input values
-    if (size < 0 || size > MAXLINE || unit < 0 || unit >= USLOSS_TERM_UNITS)
-        return -1;
+    int unit = (long) sysArg->arg1;
+    int request = (long) sysArg->arg2;
+    int value = (long) sysArg->arg3;
     
-    // get to know this process
-    int pid = getpid();
-    ProcTable[pid % MAXPROC].pid = pid;
+    int termResult = termControlReal(unit, request, value);
     
-    if (debugflag4)
-        USLOSS_Console("\t\ttermWriteReal(): user process %d wants to write on term %d with the following message:\n\t\t%s\n\t\t\tIt will be blocked on its private mailbox %d.\n", pid, unit, buf, ProcTable[pid % MAXPROC].privateMboxID);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termControl */
+
+/* ------------------------- termControlReal ----------------------------------- */
+// purpose: change how a terminal unit delivers input or output, -1 for an unknown unit, request or value
+int termControlReal(int unit, int request, int value)
+{
+    if (unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    if (debugflag4)
+        USLOSS_Console("\ttermControlReal(): unit %d, request %d, value %d\n", unit, request, value);
+    
+    switch (request)
+    {
+        case TERM_CTL_MODE:
+            if (value != TERM_MODE_LINE && value != TERM_MODE_RAW)
+                return -1;
+            disableInterrupts();
+            termSetMode(unit, value);
+            termSelectWake();
+            enableInterrupts();
+            return 0;
+        case TERM_CTL_RAW_MIN:
+            if (value < 0 || value > MAXLINE)
+                return -1;
+            disableInterrupts();
+            termRawMin[unit] = value;
+            if (termRaw[unit])
+                termRawDeliver(unit);
+            termSelectWake();
+            enableInterrupts();
+            return 0;
+        case TERM_CTL_RAW_TIME:
+            if (value < 0)
+                return -1;
+            termRawTime[unit] = value;
+            return 0;
+        case TERM_CTL_WRITE_BEHIND:
+            if (value != 0 && value != 1)
+                return -1;
+            termWriteBehind[unit] = value;
+            return 0;
+        case TERM_CTL_COMBINE:
+            if (value < 0)
+                return -1;
+            disableInterrupts();
+            termCombine[unit] = value;
+            
+            // a shorter window applies to the open one too
+            if (termCombineLeft[unit] > value)
+                termCombineLeft[unit] = value > 0 ? value : 1;
+            enableInterrupts();
+            return 0;
+        case TERM_CTL_POLL_DEPTH:
+            if (value < 0)
+                return -1;
+            termPollDepth[unit] = value;
+            return 0;
+        case TERM_CTL_LOOPBACK:
+            return termSetLoopback(unit, value);
+    }
+    
+    return -1;
+} /* end of termControlReal */
+
+/* ------------------------- termSelect ----------------------------------- */
+void termSelect(systemArgs* sysArg)
+{
+    int mask = (long) sysArg->arg1;
+    int timeout = (long) sysArg->arg2;
+    
+    int ready = 0;
+    int termResult = termSelectReal(mask, timeout, &ready);
+    
+    sysArg->arg1 = (void *) ((long)ready);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termSelect */
+
+/* ------------------------- termSelectReal ----------------------------------- */
+// purpose: wait until one of the TERM_SELECT_* conditions in mask holds, or timeout milliseconds passed,
+//          0 polls and a negative timeout waits for good
+int termSelectReal(int mask, int timeout, int* ready)
+{
+    // check illegal input values
+    if (mask == 0 || (mask & ~((1 << (2 * USLOSS_TERM_UNITS)) - 1)) != 0)
+        return -1;
+    
+    procPtr proc = &ProcTable[getpid() % MAXPROC];
+    int deadline = 0;
+    if (timeout > 0)
+        deadline = USLOSS_Clock() + 1000 * timeout;
+    
+    if (debugflag4)
+        USLOSS_Console("\ttermSelectReal(): pid %d waits on mask 0x%x for %d ms\n", getpid(), mask, timeout);
+    
+    disableInterrupts();
+    while ((*ready = termSelectReady(mask)) == 0 && timeout != 0)
+    {
+        if (deadline != 0 && USLOSS_Clock() >= deadline)
+            break;
+        
+        // a driver or ClockDriver takes us off the list when it wakes us
+        proc->pid = getpid();
+        proc->selectMask = mask;
+        proc->wakeTime = deadline;
+        addWaiter(&termSelectWaiters, proc);
+        enableInterrupts();
+        
+        MboxReceive(proc->waitMboxID, NULL, 0);
+        
+        // someone else may have taken the input meanwhile, check again
+        disableInterrupts();
+    }
+    enableInterrupts();
+    
+    return 0;
+} /* end of termSelectReal */
+
+/* ------------------------- termTryRead ----------------------------------- */
+void termTryRead(systemArgs* sysArg)
+{
+    char* buf = (char *) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int unit = (long) sysArg->arg3;
+    
+    int sizeRead = 0;
+    int termResult = termTryReadReal(buf, size, unit, &sizeRead);
+    
+    sysArg->arg2 = (void *) ((long)sizeRead);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termTryRead */
+
+/* ------------------------- termTryReadReal ----------------------------------- */
+// purpose: termReadReal without waiting, TERM_WOULD_BLOCK if no input can be served right now
+int termTryReadReal(char* buf, int size, int unit, int* sizeRead)
+{
+    // check illegal input values
+    if (size < 0 || size > MAXLINE || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    disableInterrupts();
+    if (!termReadReady(unit, size))
+    {
+        enableInterrupts();
+        *sizeRead = 0;
+        return TERM_WOULD_BLOCK;
+    }
+    
+    if (termRaw[unit])
+        *sizeRead = termTakeBytes(unit, buf, size);
+    else
+        *sizeRead = termTakeLine(unit, buf, size);
+    enableInterrupts();
+    
+    return 0;
+} /* end of termTryReadReal */
+
+/* ------------------------- termTryWrite ----------------------------------- */
+void termTryWrite(systemArgs* sysArg)
+{
+    char* buf = (char*) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int unit = (long) sysArg->arg3;
+    
+    int sizeWritten = 0;
+    int termResult = termTryWriteReal(buf, size, unit, &sizeWritten);
+    
+    sysArg->arg2 = (void *) ((long)sizeWritten);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termTryWrite */
+
+/* ------------------------- termTryWriteReal ----------------------------------- */
+// purpose: queue a line for TermDriver and return without waiting for it to be transmitted,
+//          TERM_WOULD_BLOCK if the unit's queue is full
+int termTryWriteReal(char* buf, int size, int unit, int* sizeWritten)
+{
+    // check illegal input values
+    if (size < 0 || size > MAXLINE || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    // nobody is completed for this line
+    termWriteReq req;
+    req.pid = -1;
+    req.owner = getpid();
+    req.urgent = 0;
+    req.size = size;
+    req.iov = NULL;
+    memcpy(req.data, buf, size);
+    
+    *sizeWritten = 0;
+    req.queuedAt = USLOSS_Clock();
+    disableInterrupts();
+    if (termWritesQueued[unit] >= TERM_WRITE_SLOTS || MboxCondSend(termWriteMbox[unit], &req, TERM_WRITE_REQ_SIZE(size)) != 0)
+    {
+        enableInterrupts();
+        return TERM_WOULD_BLOCK;
+    }
+    termWritesQueued[unit]++;
+    enableInterrupts();
+    
+    termKick(unit);
+    
+    *sizeWritten = size;
+    return 0;
+} /* end of termTryWriteReal */
+
+/* ------------------------- termFlush ----------------------------------- */
+void termFlush(systemArgs* sysArg)
+{
+    int unit = (long) sysArg->arg1;
+    
+    int termResult = termFlushReal(unit);
+    
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termFlush */
+
+/* ------------------------- termFlushReal ----------------------------------- */
+// purpose: wait until everything queued on a unit, write-behind lines included, has been transmitted
+int termFlushReal(int unit)
+{
+    if (unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    procPtr proc = &ProcTable[getpid() % MAXPROC];
+    
+    disableInterrupts();
+    if (termOutputIdle(unit))
+    {
+        enableInterrupts();
+        return 0;
+    }
+    proc->pid = getpid();
+    addWaiter(&termFlushWaiters[unit], proc);
+    enableInterrupts();
+    
+    // TermDriver wakes us once it runs out of lines
+    MboxReceive(proc->waitMboxID, NULL, 0);
+    
+    return 0;
+} /* end of termFlushReal */
+
+/* ------------------------- termReadLines ----------------------------------- */
+void termReadLines(systemArgs* sysArg)
+{
+    char* buf = (char *) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int unit = (long) sysArg->arg3;
+    int* lens = (int *) sysArg->arg4;
+    int maxLines = (long) sysArg->arg5;
+    
+    int linesRead = 0;
+    int termResult = termReadLinesReal(buf, size, unit, lens, maxLines, &linesRead);
+    
+    sysArg->arg2 = (void *) ((long)linesRead);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termReadLines */
+
+/* ------------------------- termReadLinesReal ----------------------------------- */
+// purpose: wait for one line like termReadReal, then append every further buffered line that fits in buf,
+//          the length of each line goes to lens
+int termReadLinesReal(char* buf, int size, int unit, int* lens, int maxLines, int* linesRead)
+{
+    // check illegal input values, raw input has no lines
+    if (size < 0 || unit < 0 || unit >= USLOSS_TERM_UNITS || lens == NULL || maxLines <= 0 || termRaw[unit])
+        return -1;
+    
+    int used = 0;
+    int result = termReadReal(buf, size < MAXLINE ? size : MAXLINE, unit, &used);
+    if (result != 0)
+        return result;
+    lens[0] = used;
+    *linesRead = 1;
+    
+    disableInterrupts();
+    while (*linesRead < maxLines && !termRaw[unit] && ringCount(&termInputLens[unit]) > 0
+           && (unsigned char) ringPeek(&termInputLens[unit]) <= size - used)
+    {
+        lens[*linesRead] = termTakeLine(unit, buf + used, size - used);
+        used += lens[*linesRead];
+        (*linesRead)++;
+    }
+    enableInterrupts();
+    
+    if (debugflag4)
+        USLOSS_Console("\ttermReadLinesReal(): unit %d, %d lines in %d bytes\n", unit, *linesRead, used);
+    
+    return 0;
+} /* end of termReadLinesReal */
+
+/* ------------------------- termWriteReal ----------------------------------- */
+// purpose: write size bytes and wait until they are transmitted, longer than MAXLINE is streamed from buf by TermDriver
+int termWriteReal(char* buf, int size, int unit, int* sizeWritten)
+{
+    // check illegal input values
+    if (size < 0 || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    // get to know this process
+    int pid = getpid();
+    procPtr writer = &ProcTable[pid % MAXPROC];
+    writer->pid = pid;
+    
+    if (debugflag4)
+        USLOSS_Console("\t\ttermWriteReal(): user process %d wants to write on term %d with the following message:\n\t\t%.*s\n\t\t\tIt will be blocked on its mailbox %d.\n", pid, unit, size, buf, writer->waitMboxID);
+    
+    // write-behind, TermDriver transmits copies and nobody waits for them
+    if (termWriteBehind[unit])
+    {
+        termQueueBehind(unit, buf, size);
+        *sizeWritten = size;
+        return 0;
+    }
+    
+    // one record carries who we are and the line, several writers can queue up
+    termWriteReq req;
+    req.pid = pid;
+    req.owner = pid;
+    req.urgent = 0;
+    req.size = size;
+    req.iov = NULL;
+    if (size <= MAXLINE)
+    {
+        memcpy(req.data, buf, size);
+        *sizeWritten = termSendAndWait(unit, &req, TERM_WRITE_REQ_SIZE(size));
+        return 0;
+    }
+    
+    // we stay blocked until TermDriver is done with buf
+    termIovec whole = {buf, size};
+    req.iov = &whole;
+    req.iovCount = 1;
+    *sizeWritten = termSendAndWait(unit, &req, TERM_WRITE_REQ_SIZE(0));
+    
+    return 0;
+}
+
+/* ------------------------- termWriteV ----------------------------------- */
+void termWriteV(systemArgs* sysArg)
+{
+    termIovec* iov = (termIovec*) sysArg->arg1;
+    int count = (long) sysArg->arg2;
+    int unit = (long) sysArg->arg3;
+    
+    int sizeWritten = 0;
+    int termResult = termWriteVReal(iov, count, unit, &sizeWritten);
+    
+    sysArg->arg2 = (void *) ((long)sizeWritten);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termWriteV */
+
+/* ------------------------- termWriteVReal ----------------------------------- */
+// purpose: transmit count pieces as one contiguous stream with a single completion, TermDriver reads them in place
+int termWriteVReal(termIovec* iov, int count, int unit, int* sizeWritten)
+{
+    // check illegal input values
+    if (iov == NULL || count <= 0 || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    int size = 0;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (iov[i].len < 0 || (iov[i].base == NULL && iov[i].len > 0))
+            return -1;
+        size += iov[i].len;
+    }
+    
+    if (debugflag4)
+        USLOSS_Console("\t\ttermWriteVReal(): user process %d writes %d pieces, %d bytes on term %d\n", getpid(), count, size, unit);
+    
+    // the pieces stay in place, we are blocked until TermDriver is done with them
+    termWriteReq req;
+    req.pid = getpid();
+    req.owner = req.pid;
+    req.urgent = 0;
+    req.size = size;
+    req.iov = iov;
+    req.iovCount = count;
+    *sizeWritten = termSendAndWait(unit, &req, TERM_WRITE_REQ_SIZE(0));
+    
+    return 0;
+} /* end of termWriteVReal */
+
+/* ------------------------- termWriteUrgent ----------------------------------- */
+void termWriteUrgent(systemArgs* sysArg)
+{
+    char* buf = (char*) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int unit = (long) sysArg->arg3;
+    
+    int sizeWritten = 0;
+    int termResult = termWriteUrgentReal(buf, size, unit, &sizeWritten);
+    
+    sysArg->arg2 = (void *) ((long)sizeWritten);
+    sysArg->arg4 = (void *) ((long)termResult);
+    
+    setUserMode();
+} /* end of termWriteUrgent */
+
+/* ------------------------- termWriteUrgentReal ----------------------------------- */
+// purpose: write a line that TermDriver transmits ahead of ordinary queued output, blocks until it is out
+int termWriteUrgentReal(char* buf, int size, int unit, int* sizeWritten)
+{
+    // check illegal input values
+    if (buf == NULL || size < 0 || size > MAXLINE || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        return -1;
+    
+    if (debugflag4)
+        USLOSS_Console("\t\ttermWriteUrgentReal(): user process %d writes %d urgent bytes on term %d\n", getpid(), size, unit);
+    
+    termWriteReq req;
+    req.pid = getpid();
+    req.owner = req.pid;
+    req.urgent = 1;
+    req.size = size;
+    req.iov = NULL;
+    memcpy(req.data, buf, size);
+    *sizeWritten = termSendAndWait(unit, &req, TERM_WRITE_REQ_SIZE(size));
+    
+    return 0;
+} /* end of termWriteUrgentReal */
+
+/* ------------------------- termStatsCall ----------------------------------- */
+void termStatsCall(systemArgs* sysArg)
+{
+    int unit = (long) sysArg->arg1;
+    termStats *stats = sysArg->arg2;
+    
+    if (stats == NULL || unit < 0 || unit >= USLOSS_TERM_UNITS)
+        sysArg->arg4 = (void *) -1L;
+    else
+    {
+        disableInterrupts();
+        *stats = termStat[unit];
+        enableInterrupts();
+        sysArg->arg4 = (void *) 0L;
+    }
+    
+    setUserMode();
+} /* end of termStatsCall */
+
+/* ------------------------- pipeCreate ----------------------------------- */
+void pipeCreate(systemArgs* sysArg)
+{
+    int size = (long) sysArg->arg1;
+    
+    int pipeID = -1;
+    int pipeResult = pipeCreateReal(size, &pipeID);
+    
+    sysArg->arg1 = (void *) ((long)pipeID);
+    sysArg->arg4 = (void *) ((long)pipeResult);
+    
+    setUserMode();
+} /* end of pipeCreate */
+
+/* ------------------------- pipeCreateReal ----------------------------------- */
+// purpose: make a pipe buffering up to size bytes, -1 if size is illegal or all pipes are in use
+int pipeCreateReal(int size, int* pipeID)
+{
+    if (size <= 0 || size > PIPE_MAX_SIZE)
+        return -1;
+    
+    int i;
+    disableInterrupts();
+    for (i = 0; i < MAXPIPES; i++)
+        if (!pipeUsed[i])
+            break;
+    if (i == MAXPIPES)
+    {
+        enableInterrupts();
+        return -1;
+    }
+    // readers and writers may see the id as soon as it is used, so the ring must be ready first
+    ringInit(&pipeRing[i], size);
+    pipeReaders[i] = NULL;
+    pipeWriters[i] = NULL;
+    pipeUsed[i] = 1;
+    enableInterrupts();
+    
+    if (debugflag4)
+        USLOSS_Console("\t\tpipeCreateReal(): process %d created pipe %d of %d bytes\n", getpid(), i, size);
+    
+    *pipeID = i;
+    return 0;
+} /* end of pipeCreateReal */
+
+/* ------------------------- pipeRead ----------------------------------- */
+void pipeRead(systemArgs* sysArg)
+{
+    char* buf = (char*) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int pipeID = (long) sysArg->arg3;
+    
+    int sizeRead = 0;
+    int pipeResult = pipeReadReal(buf, size, pipeID, &sizeRead);
+    
+    sysArg->arg2 = (void *) ((long)sizeRead);
+    sysArg->arg4 = (void *) ((long)pipeResult);
+    
+    setUserMode();
+} /* end of pipeRead */
+
+/* ------------------------- pipeReadReal ----------------------------------- */
+// purpose: take up to size buffered bytes of a pipe, blocks while it is empty until a writer hands
+//          bytes straight to buf
+int pipeReadReal(char* buf, int size, int pipeID, int* sizeRead)
+{
+    // check illegal input values
+    if (buf == NULL || size < 0 || pipeID < 0 || pipeID >= MAXPIPES)
+        return -1;
+    
+    procPtr reader = &ProcTable[getpid() % MAXPROC];
+    reader->pid = getpid();
+    
+    disableInterrupts();
+    if (!pipeUsed[pipeID])
+    {
+        enableInterrupts();
+        return -1;
+    }
+    int len = ringCount(&pipeRing[pipeID]);
+    if (len > 0 || size == 0)
+    {
+        if (len > size)
+            len = size;
+        
+        int i;
+        for (i = 0; i < len; i++)
+            buf[i] = ringGet(&pipeRing[pipeID]);
+        
+        // there is room now, writers try again
+        while (pipeWriters[pipeID] != NULL)
+        {
+            MboxCondSend(pipeWriters[pipeID]->waitMboxID, NULL, 0);
+            pipeWriters[pipeID] = pipeWriters[pipeID]->nextWaitPtr;
+        }
+        enableInterrupts();
+        
+        *sizeRead = len;
+        return 0;
+    }
+    
+    // empty, the next writer copies into buf for us
+    reader->waitBuf = buf;
+    reader->waitSize = size;
+    addWaiter(&pipeReaders[pipeID], reader);
+    enableInterrupts();
+    
+    if (debugflag4)
+        USLOSS_Console("\t\tpipeReadReal(): process %d waits on empty pipe %d\n", reader->pid, pipeID);
+    
+    MboxReceive(reader->waitMboxID, NULL, 0);
+    
+    // the pipe was closed under us
+    if (reader->waitSize < 0)
+        return -1;
+    
+    *sizeRead = reader->waitSize;
+    return 0;
+} /* end of pipeReadReal */
+
+/* ------------------------- pipeWrite ----------------------------------- */
+void pipeWrite(systemArgs* sysArg)
+{
+    char* buf = (char*) sysArg->arg1;
+    int size = (long) sysArg->arg2;
+    int pipeID = (long) sysArg->arg3;
+    
+    int sizeWritten = 0;
+    int pipeResult = pipeWriteReal(buf, size, pipeID, &sizeWritten);
+    
+    sysArg->arg2 = (void *) ((long)sizeWritten);
+    sysArg->arg4 = (void *) ((long)pipeResult);
+    
+    setUserMode();
+} /* end of pipeWrite */
+
+/* ------------------------- pipeWriteReal ----------------------------------- */
+// purpose: write all size bytes to a pipe, straight into the buffers of blocked readers first,
+//          blocks while the pipe is full
+int pipeWriteReal(char* buf, int size, int pipeID, int* sizeWritten)
+{
+    // check illegal input values
+    if (buf == NULL || size < 0 || pipeID < 0 || pipeID >= MAXPIPES)
+        return -1;
+    
+    procPtr writer = &ProcTable[getpid() % MAXPROC];
+    writer->pid = getpid();
+    
+    int done = 0;
+    disableInterrupts();
+    if (!pipeUsed[pipeID])
+    {
+        enableInterrupts();
+        return -1;
+    }
+    while (done < size)
+    {
+        // readers only wait on an empty pipe, so nothing buffered goes ahead of these bytes
+        if (pipeReaders[pipeID] != NULL)
+        {
+            procPtr reader = pipeReaders[pipeID];
+            pipeReaders[pipeID] = reader->nextWaitPtr;
+            
+            int len = size - done < reader->waitSize ? size - done : reader->waitSize;
+            memcpy(reader->waitBuf, buf + done, len);
+            reader->waitSize = len;
+            MboxCondSend(reader->waitMboxID, NULL, 0);
+            
+            done += len;
+            continue;
+        }
+        
+        while (done < size && ringPut(&pipeRing[pipeID], buf[done]) == 0)
+            done++;
+        if (done == size)
+            break;
+        
+        // full, wait until a reader made room
+        writer->waitSize = 0;
+        addWaiter(&pipeWriters[pipeID], writer);
+        enableInterrupts();
+        
+        if (debugflag4)
+            USLOSS_Console("\t\tpipeWriteReal(): process %d waits on full pipe %d, %d of %d bytes written\n", writer->pid, pipeID, done, size);
+        
+        MboxReceive(writer->waitMboxID, NULL, 0);
+        
+        // the pipe was closed under us, report what got in before
+        if (writer->waitSize < 0)
+        {
+            *sizeWritten = done;
+            return -1;
+        }
+        disableInterrupts();
+    }
+    enableInterrupts();
+    
+    *sizeWritten = done;
+    return 0;
+} /* end of pipeWriteReal */
+
+/* ------------------------- pipeClose ----------------------------------- */
+void pipeClose(systemArgs* sysArg)
+{
+    int pipeID = (long) sysArg->arg1;
+    
+    int pipeResult = pipeCloseReal(pipeID);
+    
+    sysArg->arg4 = (void *) ((long)pipeResult);
+    
+    setUserMode();
+} /* end of pipeClose */
+
+/* ------------------------- pipeCloseReal ----------------------------------- */
+// purpose: release a pipe and its buffer so PipeCreate can hand the id out again, processes blocked
+//          on it return -1, -1 if pipeID is not an open pipe
+int pipeCloseReal(int pipeID)
+{
+    if (pipeID < 0 || pipeID >= MAXPIPES)
+        return -1;
+    
+    disableInterrupts();
+    if (!pipeUsed[pipeID])
+    {
+        enableInterrupts();
+        return -1;
+    }
+    pipeUsed[pipeID] = 0;
+    
+    while (pipeReaders[pipeID] != NULL)
+    {
+        pipeReaders[pipeID]->waitSize = -1;
+        MboxCondSend(pipeReaders[pipeID]->waitMboxID, NULL, 0);
+        pipeReaders[pipeID] = pipeReaders[pipeID]->nextWaitPtr;
+    }
+    while (pipeWriters[pipeID] != NULL)
+    {
+        pipeWriters[pipeID]->waitSize = -1;
+        MboxCondSend(pipeWriters[pipeID]->waitMboxID, NULL, 0);
+        pipeWriters[pipeID] = pipeWriters[pipeID]->nextWaitPtr;
+    }
+    
+    free(pipeRing[pipeID].buf);
+    pipeRing[pipeID].buf = NULL;
+    enableInterrupts();
+    
+    if (debugflag4)
+        USLOSS_Console("\t\tpipeCloseReal(): process %d closed pipe %d\n", getpid(), pipeID);
+    
+    return 0;
+} /* end of pipeCloseReal */
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+//%%%%%%%%%%%%%%%%%%%%%%%%% block devices %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+/* ------------------------- blockDev ----------------------------------- */
+// purpose: operations table of a physical or virtual disk unit, NULL if there is no such unit
+blockDevOps *blockDev(int unit)
+{
+    if (unit >= 0 && unit < USLOSS_DISK_UNITS)
+        return &physDiskOps;
+    if (unit == DISK_MIRROR_UNIT)
+        return &mirrorOps;
+    if (unit == DISK_RAM_UNIT)
+        return &ramDiskOps;
+    
+    return NULL;
+} /* end of blockDev */
+
+/* ------------------------- blockDevIO ----------------------------------- */
+// purpose: submit a batch of requests of the current process to unit and block until all of them completed, returns the first failing status
+int blockDevIO(int unit, diskReqPtr reqs)
+{
+    int pending = blockDev(unit)->submit(unit, reqs);
+    int status = 0;
+    
+    // synchronous backends are done already and leave their status in the requests
+    if (pending == 0)
+    {
+        for (; reqs != NULL && status == 0; reqs = reqs->next)
+            status = reqs->status;
+        return status;
+    }
+    
+    return blockDevWait(pending);
+} /* end of blockDevIO */
+
+/* ------------------------- blockDevWait ----------------------------------- */
+// purpose: block until pending requests submitted by the current process completed, they may sit on different units
+int blockDevWait(int pending)
+{
+    int status = 0;
+    int reqStatus;
+    
+    // every completion arrives on our private mailbox
+    while (pending > 0)
+    {
+        MboxReceive(ProcTable[getpid() % MAXPROC].privateMboxID, &reqStatus, sizeof(int));
+        if (status == 0)
+            status = reqStatus;
+        pending--;
+    }
+    
+    return status;
+} /* end of blockDevWait */
+
+/* ------------------------- diskUnitValid ----------------------------------- */
+int diskUnitValid(int unit)
+{
+    return blockDev(unit) != NULL;
+} /* end of diskUnitValid */
+
+/* ------------------------- diskUnitTracks ----------------------------------- */
+int diskUnitTracks(int unit)
+{
+    int sector, track, disk;
+    
+    blockDev(unit)->geometry(unit, &sector, &track, &disk);
+    
+    return disk;
+} /* end of diskUnitTracks */
+
+/* ------------------------- physDiskSubmit ----------------------------------- */
+// purpose: put a batch of requests on a DiskDriver's queue and wake the driver once for all of them
+int physDiskSubmit(int unit, diskReqPtr reqs)
+{
+    int count = 0;
+    
+    while (reqs != NULL)
+    {
+        diskReqPtr next = reqs->next;
+        
+        reqs->unit = unit;
+        reqs->nextDiskPtr = NULL;
+        addDiskRequest(&diskQueue[unit], reqs);
+        diskQueueLen[unit]++;
+        count++;
+        
+        reqs = next;
+    }
+    
+    if (debugflag4 || diskDebug)
+    {
+        USLOSS_Console("\tphysDiskSubmit(): %d request(s) queued on disk %d\n", count, unit);
+        printDiskReqQueue(&diskQueue[unit]);
+    }
+    
+    // wake up disk driver
+    if (count > 0)
+        MboxSend(diskMbox[unit], NULL, 0);
+    
+    return count;
+} /* end of physDiskSubmit */
+
+/* ------------------------- physDiskComplete ----------------------------------- */
+// purpose: report a finished request to whoever waits for it, requests of stacked devices go back to the pool
+void physDiskComplete(diskReqPtr req)
+{
+    int mbox = req->doneMboxID;
+    int status = req->status;
+    
+    if (req->pooled)
+        freeDiskReq(req);
+    
+    MboxSend(mbox, &status, sizeof(int));
+} /* end of physDiskComplete */
+
+/* ------------------------- physDiskGeometry ----------------------------------- */
+int physDiskGeometry(int unit, int* sector, int* track, int* disk)
+{
+    *sector = USLOSS_DISK_SECTOR_SIZE;
+    *track = USLOSS_DISK_TRACK_SIZE;
+    *disk = diskTrack[unit];
+    
+    return 0;
+} /* end of physDiskGeometry */
+
+/* ------------------------- physDiskFlush ----------------------------------- */
+// purpose: nothing to flush, a physical write completes only once it is on the disk
+int physDiskFlush(int unit)
+{
+    return 0;
+} /* end of physDiskFlush */
+
+/* ------------------------- mirrorSubmit ----------------------------------- */
+// purpose: split a batch over both halves of the mirror, reads go to one half and writes to both, each half still gets a single submit
+int mirrorSubmit(int unit, diskReqPtr reqs)
+{
+    diskReqPtr halves[USLOSS_DISK_UNITS] = {NULL, NULL};
+    
+    while (reqs != NULL)
+    {
+        // each half would wrap at its own end, the mirror wraps at the smaller one
+        mirrorSplit(unit, reqs);
+        diskReqPtr next = reqs->next;
+        
+        if (reqs->opr == USLOSS_DISK_READ)
+        {
+            // both halves hold the same data, read from the cheaper one
+            int pick = mirrorPickUnit(reqs->track);
+            reqs->next = halves[pick];
+            halves[pick] = reqs;
+        }
+        else
+        {
+            // disk1 gets a copy of the request, completed to the same mailbox
+            diskReqPtr twin = allocDiskReq();
+            *twin = *reqs;
+            twin->pooled = 1;
+            
+            reqs->next = halves[0];
+            halves[0] = reqs;
+            twin->next = halves[1];
+            halves[1] = twin;
+            mirrorStats.writes++;
+        }
+        
+        reqs = next;
+    }
+    
+    return physDiskSubmit(0, halves[0]) + physDiskSubmit(1, halves[1]);
+} /* end of mirrorSubmit */
+
+/* ------------------------- mirrorSplit ----------------------------------- */
+// purpose: cut a request that runs past the last track of the mirror, the rest goes on at track 0
+//          in a pooled request linked right after it and completed to the same mailbox
+void mirrorSplit(int unit, diskReqPtr req)
+{
+    int avail = (diskUnitTracks(unit) - req->track) * USLOSS_DISK_TRACK_SIZE - req->first;
+    if (req->sectors <= avail)
+        return;
+    
+    int headLength = avail * USLOSS_DISK_SECTOR_SIZE - req->offset;
+    diskReqPtr rest = allocDiskReq();
+    *rest = *req;
+    rest->pooled = 1;
+    rest->buf = req->buf + headLength;
+    rest->sectors = req->sectors - avail;
+    rest->track = 0;
+    rest->first = 0;
+    rest->offset = 0;
+    rest->length = req->length - headLength;
+    
+    req->sectors = avail;
+    req->length = headLength;
+    req->next = rest;
+} /* end of mirrorSplit */
+
+/* ------------------------- mirrorGeometry ----------------------------------- */
+// purpose: the mirror is as big as its smaller half
+int mirrorGeometry(int unit, int* sector, int* track, int* disk)
+{
+    *sector = USLOSS_DISK_SECTOR_SIZE;
+    *track = USLOSS_DISK_TRACK_SIZE;
+    *disk = diskTrack[0] < diskTrack[1] ? diskTrack[0] : diskTrack[1];
+    
+    return 0;
+} /* end of mirrorGeometry */
+
+/* ------------------------- mirrorFlush ----------------------------------- */
+int mirrorFlush(int unit)
+{
+    int result = physDiskFlush(0);
+    
+    if (physDiskFlush(1) != 0)
+        result = -1;
+    
+    return result;
+} /* end of mirrorFlush */
+
+/* ------------------------- mirrorPickUnit ----------------------------------- */
+// purpose: choose the physical unit that serves a mirrored read, the shorter queue wins and the closer head breaks a tie
+int mirrorPickUnit(int track)
+{
+    int pick;
+    
+    if (diskQueueLen[0] != diskQueueLen[1])
+    {
+        pick = diskQueueLen[0] < diskQueueLen[1] ? 0 : 1;
+        mirrorStats.queuePicks++;
+    }
+    else
+    {
+        int dist0 = abs(diskHead[0] - track);
+        int dist1 = abs(diskHead[1] - track);
+        pick = dist0 <= dist1 ? 0 : 1;
+        mirrorStats.nearestPicks++;
+    }
+    mirrorStats.reads[pick]++;
+    
+    if (debugflag4 || diskDebug)
+        USLOSS_Console("\tmirrorPickUnit(): track %d goes to disk %d (queues %d/%d, heads %d/%d)\n", track, pick, diskQueueLen[0], diskQueueLen[1], diskHead[0], diskHead[1]);
+    
+    return pick;
+} /* end of mirrorPickUnit */
+
+/* ------------------------- ramDiskSubmit ----------------------------------- */
+// purpose: serve a batch straight from kernel memory, nothing is left to wait for
+int ramDiskSubmit(int unit, diskReqPtr reqs)
+{
+    for (; reqs != NULL; reqs = reqs->next)
+    {
+        ramDiskTransfer(reqs);
+        ramDiskOps.complete(reqs);
+    }
+    
+    return 0;
+} /* end of ramDiskSubmit */
+
+/* ------------------------- ramDiskComplete ----------------------------------- */
+// purpose: ram disk requests finish inside submit, the caller picks the status up from the request
+void ramDiskComplete(diskReqPtr req)
+{
+    req->status = 0;
+} /* end of ramDiskComplete */
+
+/* ------------------------- ramDiskGeometry ----------------------------------- */
+int ramDiskGeometry(int unit, int* sector, int* track, int* disk)
+{
+    *sector = USLOSS_DISK_SECTOR_SIZE;
+    *track = USLOSS_DISK_TRACK_SIZE;
+    *disk = ramDiskTracks;
+    
+    return 0;
+} /* end of ramDiskGeometry */
+
+/* ------------------------- ramDiskFlush ----------------------------------- */
+int ramDiskFlush(int unit)
+{
+    return 0;
+} /* end of ramDiskFlush */
+
+/* ------------------------- ramDiskInit ----------------------------------- */
+// purpose: allocate the ram disk, RAMDISK_TRACKS in the environment overrides its default number of tracks
+void ramDiskInit()
+{
+    char *tracks = getenv("RAMDISK_TRACKS");
+    
+    ramDiskTracks = RAMDISK_TRACKS;
+    if (tracks != NULL && atoi(tracks) > 0)
+        ramDiskTracks = atoi(tracks);
+    
+    ramDisk = calloc(ramDiskTracks * USLOSS_DISK_TRACK_SIZE, USLOSS_DISK_SECTOR_SIZE);
+    if (ramDisk == NULL)
+    {
+        USLOSS_Console("ramDiskInit(): can't allocate %d tracks\n", ramDiskTracks);
+        USLOSS_Halt(1);
+    }
+    
+    if (debugflag4 || diskDebug)
+        USLOSS_Console("ramDiskInit(): ram disk has %d tracks\n", ramDiskTracks);
+} /* end of ramDiskInit */
+
+/* ------------------------- ramDiskTransfer ----------------------------------- */
+// purpose: copy a request's bytes between its buffer and the ram disk, wrapping around at the end of the disk
+void ramDiskTransfer(diskReqPtr req)
+{
+    long diskBytes = (long)ramDiskTracks * USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE;
+    long pos = ((long)req->track * USLOSS_DISK_TRACK_SIZE + req->first) * USLOSS_DISK_SECTOR_SIZE + req->offset;
+    char* buf = req->buf;
+    int remaining = req->length;
+    
+    while (remaining > 0)
+    {
+        pos %= diskBytes;
+        
+        int chunk = remaining;
+        if (chunk > diskBytes - pos)
+            chunk = diskBytes - pos;
+        
+        if (req->opr == USLOSS_DISK_WRITE)
+            memcpy(ramDisk + pos, buf, chunk);
+        else
+            memcpy(buf, ramDisk + pos, chunk);
+        
+        pos += chunk;
+        buf += chunk;
+        remaining -= chunk;
+    }
+} /* end of ramDiskTransfer */
+
+
+
+
+
+
+
+
+
+
+
+//%%%%%%%%%%%%%%%%%%%%%%%%% kernel helpers %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+/* ------------------------- check_kernel_mode ----------------------------------- */
+void check_kernel_mode(char *arg)
+{
+    if (!(USLOSS_PSR_CURRENT_MODE & USLOSS_PsrGet()))
+    {
+        USLOSS_Console("%s(): called while in user mode. Halting...\n", arg);
+    }
+} /* end of check_kernel_mode */
+
+/*---------- setUserMode ----------*/
+void setUserMode()
+{
+    if(debugflag4)
+        USLOSS_Console("setUserMode(): entered\n");
+    
+    USLOSS_PsrSet( USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE );
+} /* setUserMode */
+
+/*---------- initSysCallVec ----------*/
+void initSysCallVec()
+{
+    if (debugflag4)
+        USLOSS_Console("initSysCallVec(): entered");
+    
+    // known vectors
+    systemCallVec[SYS_SLEEP] = (void *)sleep;
+    systemCallVec[SYS_DISKSIZE] = (void *)diskSize;
+    systemCallVec[SYS_DISKWRITE] = (void *)diskWrite;
+    systemCallVec[SYS_DISKREAD] = (void *)diskRead;
+    systemCallVec[SYS_DISKMIRRORSTATS] = (void *)diskMirrorStatsCall;
+    systemCallVec[SYS_DISKPREAD] = (void *)diskPread;
+    systemCallVec[SYS_DISKPWRITE] = (void *)diskPwrite;
+    systemCallVec[SYS_DISKCOPY] = (void *)diskCopy;
+    systemCallVec[SYS_TERMREAD] = (void *)termRead;
+    systemCallVec[SYS_TERMWRITE] = (void *)termWrite;
+    systemCallVec[SYS_TERMCONTROL] = (void *)termControl;
+    systemCallVec[SYS_TERMSELECT] = (void *)termSelect;
+    systemCallVec[SYS_TERMTRYREAD] = (void *)termTryRead;
+    systemCallVec[SYS_TERMTRYWRITE] = (void *)termTryWrite;
+    systemCallVec[SYS_TERMFLUSH] = (void *)termFlush;
+    systemCallVec[SYS_TERMREADLINES] = (void *)termReadLines;
+    systemCallVec[SYS_TERMWRITEV] = (void *)termWriteV;
+    systemCallVec[SYS_TERMWRITEURGENT] = (void *)termWriteUrgent;
+    systemCallVec[SYS_TERMSTATS] = (void *)termStatsCall;
+    systemCallVec[SYS_PIPECREATE] = (void *)pipeCreate;
+    systemCallVec[SYS_PIPEREAD] = (void *)pipeRead;
+    systemCallVec[SYS_PIPEWRITE] = (void *)pipeWrite;
+    systemCallVec[SYS_PIPECLOSE] = (void *)pipeClose;
+    
+} /* end of initSysCallVec */
+
+/*---------- initProcTable ----------*/
+void initProcTable()
+{
+    if (debugflag4)
+        USLOSS_Console("initProcTable(): entered");
+    
+    int i;
+    for (i = 0; i < MAXPROC; i++)
+    {
+        clearProcess(i);
+    }
+} /* end of initProcTable */
+
+/* ------------------------- clearProcess ------------------------- */
+void clearProcess(int pid)
+{
+    ProcTable[pid] = (procStruct) {
+        .pid            = -1,
+        .nextSleepPtr    = NULL,
+        .privateMboxID  = MboxCreate(0,MAX_MESSAGE),
+        .wakeTime       = 0,
+        .nextWaitPtr    = NULL,
+        .waitBuf        = NULL,
+        .waitSize       = 0,
+        .waitMboxID     = MboxCreate(1, 0),
+        .selectMask     = 0
+    };
+    
+} /* end of clearProcess */
+
+/* ------------------------- printProcTable ------------------------- */
+void printProcTable()
+{
+    int i;
+    for (i = 0; i < MAXPROC; i++)
+    {
+        procStruct tmp = ProcTable[i];
+        USLOSS_Console("pid %5d privateMboxID %d wakeTime %d\n", tmp.pid, tmp.privateMboxID, tmp.wakeTime);
+    }
+} /* printProcTable */
+
+/* ------------------------- addSleepRequest ----------------------------------- */
+void addSleepRequest(procPtr* list, procPtr newSleep)
+{
+    if(debugflag4)
+        USLOSS_Console("addSleepRequest(): pid %d, wakeTime %d\n", newSleep->pid, newSleep->wakeTime);
     
-    // inform TermWriter the invoking process pid
-    MboxSend(termWriterPIDMbox[unit], &pid, sizeof(pid));
+    // add to empty list
+    if (*list == NULL)
+    {
+        *list = newSleep;
+        return;
+    }
+    // add to the head
+    procPtr tmp = *list;
+    if(tmp->wakeTime > newSleep->wakeTime)
+    {
+        newSleep->nextSleepPtr = *list;
+        *list = newSleep;
+        return;
+    }
+    // normal cases
+    procPtr prev = NULL;
+    procPtr curr = *list;
+    while(curr->wakeTime < newSleep->wakeTime)
+    {
+        prev = curr;
+        curr = curr->nextSleepPtr;
+        if(curr == NULL)
+            break;
+    }
+    prev->nextSleepPtr = newSleep;
+    newSleep->nextSleepPtr = curr;
     
-    // transfer the line that is going to be written
-    MboxSend(termWriterLineMbox[unit], buf, size);
+    return;
+} /* end of addSleepRequest */
+
+/* ------------------------- addWaiter ----------------------------------- */
+// purpose: append a process to a first come, first served wait list linked through nextWaitPtr
+void addWaiter(procPtr* list, procPtr proc)
+{
+    proc->nextWaitPtr = NULL;
     
-    // block the invoking process
-    MboxReceive(ProcTable[pid % MAXPROC].privateMboxID, sizeWritten, sizeof(int));
+    while (*list != NULL)
+        list = &(*list)->nextWaitPtr;
+    *list = proc;
+} /* end of addWaiter */
+
+/* ------------------------- disableInterrupts ----------------------------------- */
+// purpose: keep the driver processes from running while a system call updates what they share
+void disableInterrupts()
+{
+    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_INT);
+} /* end of disableInterrupts */
+
+/* ------------------------- enableInterrupts ----------------------------------- */
+void enableInterrupts()
+{
+    USLOSS_PsrSet(USLOSS_PsrGet() | USLOSS_PSR_CURRENT_INT);
+} /* end of enableInterrupts */
+
+/* ------------------------- printSleepList ----------------------------------- */
+void printSleepList()
+{
+    procPtr tmp = sleepList;
+    while(tmp != NULL)
+    {
+        USLOSS_Console("\t printSleepList(): %d blocked on %d wakeTime %d\n", tmp->pid, tmp->privateMboxID, tmp->wakeTime);
+        tmp = tmp->nextSleepPtr;
+    }
+} /* end of printSleepList */
+
+/* ------------------------- addDiskRequest ----------------------------------- */
+// similar with addSleepList, same algorithm, be careful with the track directions
+void addDiskRequest(diskReqPtr* diskReqQueue, diskReqPtr newDisk)
+{
+    if (debugflag4)
+        USLOSS_Console("addDiskRequest(): inserting request for track #%d\n", newDisk->track);
     
-    return 0;
+    diskReqPtr head = *diskReqQueue;
+    if (*diskReqQueue == NULL)
+    {
+        *diskReqQueue = newDisk;
+        return;
+    }
+    // adding when track is to the left of current
+    else if (head->track < newDisk->track)
+    {
+        diskReqPtr prev = NULL;
+        diskReqPtr tmp = *diskReqQueue;
+        
+        // go past requests for the same track, they were queued first and must be served first
+        while (tmp->track <= newDisk->track)
+        {
+            if (tmp->track < head->track)
+            {
+                prev->nextDiskPtr = newDisk;
+                newDisk->nextDiskPtr = tmp;
+                return;
+            }
+            prev = tmp;
+            tmp = tmp->nextDiskPtr;
+            if (tmp == NULL)
+                break;
+        }
+        prev->nextDiskPtr = newDisk;
+        newDisk->nextDiskPtr = tmp;
+    }
+    // adding when track is to the right of current
+    else
+    {
+        diskReqPtr prev = NULL;
+        diskReqPtr tmp = *diskReqQueue;
+        
+        while (tmp->track > newDisk->track)
+        {
+            prev = tmp;
+            tmp = tmp->nextDiskPtr;
+            if (tmp == NULL)
+                break;
+            if (tmp->track < head->track)
+                break;
+        }
+        if (debugflag4)
+            USLOSS_Console("\t\t wrapped around, tmp %d, prev %d\n", tmp == NULL ? -1 : tmp->track, prev->track);
+        if (tmp == NULL)
+        {
+            prev->nextDiskPtr = newDisk;
+            newDisk->nextDiskPtr = NULL;
+            return;
+        }
+        while (tmp->track <= newDisk->track)
+        {
+            prev = tmp;
+            tmp = tmp->nextDiskPtr;
+            if (tmp == NULL)
+                break;
+        }
+        if (debugflag4)
+            USLOSS_Console("\t\t out of loop, tmp %d, prev %d\n", tmp == NULL ? -1 : tmp->track, prev->track);
+        
+        prev->nextDiskPtr = newDisk;
+        newDisk->nextDiskPtr = tmp;
+        return;
+    }
+    
+    return;
+} /* end of addDiskRequest */
+
+/* ------------------------- printDiskReqQueue ----------------------------------- */
+void printDiskReqQueue(diskReqPtr* diskReqQueue)
+{
+    diskReqPtr tmp = *diskReqQueue;
+    while(tmp != NULL)
+    {
+        USLOSS_Console("\t printDiskReqQueue(): %d wants to %s on track %d\n", tmp->pid, tmp->opr == USLOSS_DISK_WRITE ? "write" : "read", tmp->track);
+        tmp = tmp->nextDiskPtr;
+    }
+} /* end of printDiskReqQueue */
+
+/* ------------------------- dequeueDiskReq ----------------------------------- */
+void dequeueDiskReq(diskReqPtr* diskQueue)
+{
+    diskReqPtr head = *diskQueue;
+    *diskQueue = head->nextDiskPtr;
+    return;
 }
 
+/* ------------------------- termSetInterrupts ----------------------------------- */
+// purpose: write a terminal's control register, interrupts follow termRecvOn and termXmitOn
+void termSetInterrupts(int unit)
+{
+    int ctrl = 0;
+    
+    // a looped unit ignores its device's input, termRecvOn still says if its peer may feed it
+    if (termRecvOn[unit] && termLoopPeer[unit] < 0)
+        ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
+    if (termXmitOn[unit])
+        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
+    
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *)((long) ctrl));
+} /* end of termSetInterrupts */
 
+/* ------------------------- termReceiveChar ----------------------------------- */
+// purpose: line discipline, add a received character to the current line and deliver the line once it is complete
+void termReceiveChar(int unit, char received)
+{
+    char *curLine = termCurLine[unit];
+    
+    if (debugflag4)
+        USLOSS_Console("\t\ttermReceiveChar(): unit %d received character '%c'\n", unit, received);
+    
+    // a line's read latency starts with its first character
+    if (termCurLinePos[unit] == 0)
+        termCurLineTime[unit] = USLOSS_Clock();
+    
+    // raw mode, the byte is readable as it is
+    if (termRaw[unit])
+    {
+        if (ringPut(&termInput[unit], received) != 0)
+            termStat[unit].drops++;
+        termInputWatch(unit);
+        if (ringCount(&termInput[unit]) == termInputSize)
+        {
+            termRecvOn[unit] = 0;
+            termSetInterrupts(unit);
+        }
+        termRawDeliver(unit);
+        termSelectWake();
+        return;
+    }
+    
+    // reaches MAXLINE
+    if (termCurLinePos[unit] == MAXLINE)
+    {
+        if (debugflag4)
+            USLOSS_Console("\t\ttermReceiveChar(): unit %d sending an incomplete line\n", unit);
+        termLineDone(unit, curLine, MAXLINE);
+        
+        // put received char to a new line
+        curLine[0] = received;
+        termCurLinePos[unit] = 1;
+        termCurLineTime[unit] = USLOSS_Clock();
+    }
+    // reaches a newline
+    else if (received == '\n')
+    {
+        curLine[termCurLinePos[unit]] = received;
+        
+        if (debugflag4)
+            USLOSS_Console("\t\ttermReceiveChar(): unit %d sending a complete line:\n%.*s\n", unit, termCurLinePos[unit] + 1, curLine);
+        termLineDone(unit, curLine, termCurLinePos[unit] + 1);
+        
+        termCurLinePos[unit] = 0;
+    }
+    // normal cases
+    else
+    {
+        curLine[termCurLinePos[unit]] = received;
+        termCurLinePos[unit]++;
+    }
+} /* end of termReceiveChar */
 
+/* ------------------------- termLineDone ----------------------------------- */
+// purpose: copy a finished line into the oldest waiting reader's buffer, or buffer it in termInput if nobody waits
+void termLineDone(int unit, char* line, int len)
+{
+    termStat[unit].linesIn++;
+    
+    procPtr reader = termReadWaiters[unit];
+    if (reader != NULL)
+    {
+        termReadWaiters[unit] = reader->nextWaitPtr;
+        
+        if (len > reader->waitSize)
+            len = reader->waitSize;
+        memcpy(reader->waitBuf, line, len);
+        reader->waitSize = len;
+        termLatency(termStat[unit].readLatency, termCurLineTime[unit]);
+        
+        MboxCondSend(reader->waitMboxID, NULL, 0);
+        return;
+    }
+    
+    // receive interrupts are only on while a whole line and the start of the next one fit,
+    // only lines fed back by termSetMode can find no room
+    if (termInputSize - ringCount(&termInput[unit]) < len)
+    {
+        termStat[unit].drops += len;
+        return;
+    }
+    
+    int i;
+    for (i = 0; i < len; i++)
+        ringPut(&termInput[unit], line[i]);
+    termInputTimes[unit][termInputLens[unit].tail % termInputLens[unit].size] = termCurLineTime[unit];
+    ringPut(&termInputLens[unit], (char) len);
+    termInputWatch(unit);
+    
+    // hold further input in the terminal until readers make room
+    if (termInputSize - ringCount(&termInput[unit]) < MAXLINE + 1)
+    {
+        if (debugflag4)
+            USLOSS_Console("\t\ttermLineDone(): unit %d input buffer full, receive interrupt off\n", unit);
+        termRecvOn[unit] = 0;
+        termSetInterrupts(unit);
+    }
+    
+    termSelectWake();
+} /* end of termLineDone */
 
+/* ------------------------- termTakeLine ----------------------------------- */
+// purpose: remove the oldest buffered line, copy up to size bytes of it to buf and return how many were copied,
+//          called with interrupts disabled
+int termTakeLine(int unit, char* buf, int size)
+{
+    termLatency(termStat[unit].readLatency, termInputTimes[unit][termInputLens[unit].head % termInputLens[unit].size]);
+    int len = (unsigned char) ringGet(&termInputLens[unit]);
+    
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        char c = ringGet(&termInput[unit]);
+        if (i < size)
+            buf[i] = c;
+    }
+    termInputFreed(unit);
+    
+    return len < size ? len : size;
+} /* end of termTakeLine */
 
+/* ------------------------- termTakeBytes ----------------------------------- */
+// purpose: raw mode, move up to size buffered bytes to buf and return how many, called with interrupts disabled
+int termTakeBytes(int unit, char* buf, int size)
+{
+    int len = ringCount(&termInput[unit]);
+    if (len > size)
+        len = size;
+    
+    int i;
+    for (i = 0; i < len; i++)
+        buf[i] = ringGet(&termInput[unit]);
+    termInputFreed(unit);
+    
+    return len;
+} /* end of termTakeBytes */
 
+/* ------------------------- termInputFreed ----------------------------------- */
+// purpose: let the terminal deliver input again once readers made room for a line
+void termInputFreed(int unit)
+{
+    if (!termRecvOn[unit] && termInputSize - ringCount(&termInput[unit]) >= MAXLINE + 1)
+    {
+        termRecvOn[unit] = 1;
+        termSetInterrupts(unit);
+    }
+    
+    // a looped peer may have been waiting for the room
+    if (termRecvOn[unit] && termLoopPeer[unit] >= 0)
+        termLoopPump(termLoopPeer[unit]);
+} /* end of termInputFreed */
 
+/* ------------------------- termReadReady ----------------------------------- */
+// purpose: 1 if a read of size bytes can be served from what is buffered, without waiting
+int termReadReady(int unit, int size)
+{
+    if (!termRaw[unit])
+        return ringCount(&termInputLens[unit]) > 0;
+    
+    // earlier raw readers get their bytes first
+    if (termReadWaiters[unit] != NULL)
+        return 0;
+    
+    int min = termRawMin[unit] < size ? termRawMin[unit] : size;
+    return ringCount(&termInput[unit]) >= min;
+} /* end of termReadReady */
 
+/* ------------------------- termRawDeliver ----------------------------------- */
+// purpose: raw mode, hand buffered bytes to waiting readers as long as the oldest one has its minimum
+void termRawDeliver(int unit)
+{
+    procPtr reader;
+    
+    while ((reader = termReadWaiters[unit]) != NULL)
+    {
+        int min = termRawMin[unit] < reader->waitSize ? termRawMin[unit] : reader->waitSize;
+        if (ringCount(&termInput[unit]) < min)
+            return;
+        
+        termReadWaiters[unit] = reader->nextWaitPtr;
+        reader->waitSize = termTakeBytes(unit, reader->waitBuf, reader->waitSize);
+        MboxCondSend(reader->waitMboxID, NULL, 0);
+    }
+} /* end of termRawDeliver */
 
+/* ------------------------- termRawTimeouts ----------------------------------- */
+// purpose: called by ClockDriver, complete raw readers whose timer ran out with whatever is buffered
+void termRawTimeouts()
+{
+    int unit;
+    int now = USLOSS_Clock();
+    
+    for (unit = 0; unit < USLOSS_TERM_UNITS; unit++)
+    {
+        if (!termRaw[unit])
+            continue;
+        
+        procPtr *prev = &termReadWaiters[unit];
+        while (*prev != NULL)
+        {
+            procPtr reader = *prev;
+            if (reader->wakeTime == 0 || reader->wakeTime > now)
+            {
+                prev = &reader->nextWaitPtr;
+                continue;
+            }
+            
+            *prev = reader->nextWaitPtr;
+            reader->waitSize = termTakeBytes(unit, reader->waitBuf, reader->waitSize);
+            MboxCondSend(reader->waitMboxID, NULL, 0);
+        }
+    }
+} /* end of termRawTimeouts */
 
+/* ------------------------- termSetMode ----------------------------------- */
+// purpose: switch a unit between line and raw input keeping what is buffered, called with interrupts disabled
+void termSetMode(int unit, int mode)
+{
+    int i;
+    int raw = (mode == TERM_MODE_RAW);
+    
+    if (raw == termRaw[unit])
+        return;
+    termRaw[unit] = raw;
+    
+    if (raw)
+    {
+        // buffered lines become plain bytes, followed by the line in progress
+        while (ringCount(&termInputLens[unit]) > 0)
+            ringGet(&termInputLens[unit]);
+        for (i = 0; i < termCurLinePos[unit]; i++)
+            ringPut(&termInput[unit], termCurLine[unit][i]);
+        termCurLinePos[unit] = 0;
+        
+        termRawDeliver(unit);
+    }
+    else
+    {
+        // run the bytes nobody read yet through the line discipline
+        int pending = ringCount(&termInput[unit]);
+        for (i = 0; i < pending; i++)
+            termReceiveChar(unit, ringGet(&termInput[unit]));
+    }
+    termInputFreed(unit);
+} /* end of termSetMode */
 
+/* ------------------------- termSelectReady ----------------------------------- */
+// purpose: the TERM_SELECT_* conditions of mask that hold right now
+int termSelectReady(int mask)
+{
+    int ready = 0;
+    int unit;
+    
+    for (unit = 0; unit < USLOSS_TERM_UNITS; unit++)
+    {
+        if ((mask & TERM_SELECT_READ(unit)) && termReadReady(unit, MAXLINE))
+            ready |= TERM_SELECT_READ(unit);
+        if ((mask & TERM_SELECT_WRITE(unit)) && termWritesQueued[unit] < TERM_WRITE_SLOTS)
+            ready |= TERM_SELECT_WRITE(unit);
+    }
+    
+    return ready;
+} /* end of termSelectReady */
 
+/* ------------------------- termSelectWake ----------------------------------- */
+// purpose: wake every TermSelect caller that now has something ready, called with interrupts disabled
+void termSelectWake()
+{
+    procPtr *prev = &termSelectWaiters;
+    
+    while (*prev != NULL)
+    {
+        procPtr proc = *prev;
+        if (termSelectReady(proc->selectMask) == 0)
+        {
+            prev = &proc->nextWaitPtr;
+            continue;
+        }
+        
+        *prev = proc->nextWaitPtr;
+        MboxCondSend(proc->waitMboxID, NULL, 0);
+    }
+} /* end of termSelectWake */
 
+/* ------------------------- termSelectTimeouts ----------------------------------- */
+// purpose: called by ClockDriver, wake TermSelect callers whose timeout passed
+void termSelectTimeouts()
+{
+    procPtr *prev = &termSelectWaiters;
+    int now = USLOSS_Clock();
+    
+    while (*prev != NULL)
+    {
+        procPtr proc = *prev;
+        if (proc->wakeTime == 0 || proc->wakeTime > now)
+        {
+            prev = &proc->nextWaitPtr;
+            continue;
+        }
+        
+        *prev = proc->nextWaitPtr;
+        MboxCondSend(proc->waitMboxID, NULL, 0);
+    }
+} /* end of termSelectTimeouts */
 
+/* ------------------------- termInputInit ----------------------------------- */
+void termInputInit()
+{
+    char *size = getenv("TERM_INPUT_SIZE");
+    
+    termInputSize = TERM_INPUT_SIZE;
+    if (size != NULL && atoi(size) > MAXLINE)
+        termInputSize = atoi(size);
+    
+    if (debugflag4)
+        USLOSS_Console("termInputInit(): %d bytes of input buffered per terminal\n", termInputSize);
+} /* end of termInputInit */
 
+/* ------------------------- termTransmit ----------------------------------- */
+// purpose: on transmit ready, send the next character, completing the writer of a finished line and starting queued ones
+void termTransmit(int unit)
+{
+    while (ringCount(&xmitRing[unit]) == 0)
+    {
+        // a long write continues with its next chunk
+        if (termXmitLeft[unit] > 0 || termXmitIovLeft[unit] > 0)
+        {
+            termXmitFill(unit);
+            continue;
+        }
+        
+        // the whole line is out, unblock its writer
+        if (termXmitSize[unit] >= 0)
+            termXmitDone(unit);
+        
+        if (termNextLine(unit))
+            continue;
+        
+        // nothing queued, stop transmit interrupts
+        termXmitOn[unit] = 0;
+        termSetInterrupts(unit);
+        termFlushWake(unit);
+        
+        // a writer may have queued a line before we turned them off
+        if (!termNextLine(unit))
+            return;
+        termXmitOn[unit] = 1;
+        termSetInterrupts(unit);
+    }
+    
+    int ctrl = 0;
+    ctrl = USLOSS_TERM_CTRL_CHAR(ctrl, ringGet(&xmitRing[unit]));
+    termStat[unit].bytesOut++;
+    if (termRecvOn[unit])
+        ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
+    if (termXmitOn[unit])
+        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
+    ctrl = USLOSS_TERM_CTRL_XMIT_CHAR(ctrl);
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*) ((long)ctrl));
+} /* end of termTransmit */
 
-//%%%%%%%%%%%%%%%%%%%%%%%%% kernel helpers %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-/* ------------------------- check_kernel_mode ----------------------------------- */
-void check_kernel_mode(char *arg)
+/* ------------------------- termXmitDone ----------------------------------- */
+// purpose: the line being transmitted is out, complete its writer
+void termXmitDone(int unit)
 {
-    if (!(USLOSS_PSR_CURRENT_MODE & USLOSS_PsrGet()))
+    // -1 is a TermTryWrite, nobody waits for it
+    if (termXmitPID[unit] >= 0)
     {
-        USLOSS_Console("%s(): called while in user mode. Halting...\n", arg);
+        procPtr writer = &ProcTable[termXmitPID[unit] % MAXPROC];
+        writer->waitSize = termXmitSize[unit];
+        MboxCondSend(writer->waitMboxID, NULL, 0);
     }
-} /* end of check_kernel_mode */
-
-/*---------- setUserMode ----------*/
-void setUserMode()
+    termXmitSize[unit] = -1;
+    termXmitPID[unit] = -1;
+    termStat[unit].linesOut++;
+    termLatency(termStat[unit].writeLatency, termXmitQueuedAt[unit]);
+} /* end of termXmitDone */
+
+/* ------------------------- termLoopPump ----------------------------------- */
+// purpose: loopback, feed the queued output of unit to its peer's line discipline in place of the device,
+//          stops while the peer has no room for input, called with interrupts disabled
+void termLoopPump(int unit)
 {
-    if(debugflag4)
-        USLOSS_Console("setUserMode(): entered\n");
+    int peer = termLoopPeer[unit];
     
-    USLOSS_PsrSet( USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE );
-} /* setUserMode */
+    while (termRecvOn[peer])
+    {
+        if (ringCount(&xmitRing[unit]) > 0)
+        {
+            termStat[unit].bytesOut++;
+            termStat[peer].bytesIn++;
+            termReceiveChar(peer, ringGet(&xmitRing[unit]));
+            continue;
+        }
+        
+        // a long write continues with its next chunk
+        if (termXmitLeft[unit] > 0 || termXmitIovLeft[unit] > 0)
+        {
+            termXmitFill(unit);
+            continue;
+        }
+        
+        if (termXmitSize[unit] >= 0)
+            termXmitDone(unit);
+        
+        if (!termNextLine(unit))
+        {
+            termFlushWake(unit);
+            return;
+        }
+    }
+} /* end of termLoopPump */
 
-/*---------- initSysCallVec ----------*/
-void initSysCallVec()
+/* ------------------------- termSetLoopback ----------------------------------- */
+// purpose: connect unit and peer back to back, or disconnect unit if peer is -1,
+//          both units must have no output in progress to be connected
+int termSetLoopback(int unit, int peer)
 {
-    if (debugflag4)
-        USLOSS_Console("initSysCallVec(): entered");
+    if (peer < -1 || peer >= USLOSS_TERM_UNITS || peer == unit)
+        return -1;
     
-    // known vectors
-    systemCallVec[SYS_SLEEP] = (void *)sleep;
-    systemCallVec[SYS_DISKSIZE] = (void *)diskSize;
-    systemCallVec[SYS_DISKWRITE] = (void *)diskWrite;
-    systemCallVec[SYS_DISKREAD] = (void *)diskRead;
-    systemCallVec[SYS_TERMREAD] = (void *)termRead;
-    systemCallVec[SYS_TERMWRITE] = (void *)termWrite;
+    disableInterrupts();
     
-} /* end of initSysCallVec */
-
-/*---------- initProcTable ----------*/
-void initProcTable()
-{
-    if (debugflag4)
-        USLOSS_Console("initProcTable(): entered");
+    int old = termLoopPeer[unit];
+    if (peer == -1)
+    {
+        if (old >= 0)
+            termLoopPeer[old] = -1;
+        termLoopPeer[unit] = -1;
+        enableInterrupts();
+        
+        // both devices deliver input again
+        termSetInterrupts(unit);
+        if (old >= 0)
+            termSetInterrupts(old);
+        
+        // whatever was left for the peer goes to the device now
+        termKick(unit);
+        if (old >= 0)
+            termKick(old);
+        return 0;
+    }
     
-    int i;
-    for (i = 0; i < MAXPROC; i++)
+    if (old == peer)
     {
-        clearProcess(i);
+        enableInterrupts();
+        return 0;
     }
-} /* end of initProcTable */
+    
+    if (old >= 0 || termLoopPeer[peer] >= 0 || termXmitOn[unit] || termXmitOn[peer] ||
+        !termOutputIdle(unit) || !termOutputIdle(peer))
+    {
+        enableInterrupts();
+        return -1;
+    }
+    
+    termLoopPeer[unit] = peer;
+    termLoopPeer[peer] = unit;
+    enableInterrupts();
+    
+    // the devices' input is ignored while looped
+    termSetInterrupts(unit);
+    termSetInterrupts(peer);
+    
+    return 0;
+} /* end of termSetLoopback */
 
-/* ------------------------- clearProcess ------------------------- */
-void clearProcess(int pid)
+/* ------------------------- termInputWatch ----------------------------------- */
+// purpose: keep the high-water mark of a unit's buffered input
+void termInputWatch(int unit)
 {
-    ProcTable[pid] = (procStruct) {
-        .pid            = -1,
-        .nextSleepPtr    = NULL,
-        .privateMboxID  = MboxCreate(0,MAX_MESSAGE),
-        .wakeTime       = 0
-    };
-    
-} /* end of clearProcess */
+    if (ringCount(&termInput[unit]) > termStat[unit].inputHigh)
+        termStat[unit].inputHigh = ringCount(&termInput[unit]);
+} /* end of termInputWatch */
 
-/* ------------------------- printProcTable ------------------------- */
-void printProcTable()
+/* ------------------------- termLatency ----------------------------------- */
+// purpose: count the time since start, a USLOSS_Clock() value, in its TERM_LAT_BUCKETS bucket of hist
+void termLatency(int* hist, int start)
 {
-    int i;
-    for (i = 0; i < MAXPROC; i++)
+    int ms = (USLOSS_Clock() - start) / 1000;
+    int bucket = 0;
+    
+    while (bucket < TERM_LAT_BUCKETS - 1 && ms >= (1 << (2 * bucket)))
+        bucket++;
+    hist[bucket]++;
+} /* end of termLatency */
+
+/* ------------------------- termPollTransmit ----------------------------------- */
+// purpose: while a deep backlog is queued, turn transmit interrupts off and poll for transmit ready,
+//          sending each character as soon as the device takes it, back to interrupts once the
+//          backlog drains or the device stays busy for TERM_POLL_USEC
+void termPollTransmit(int unit)
+{
+    int status;
+    
+    if (termPollDepth[unit] == 0 || !termXmitOn[unit] ||
+        termWritesQueued[unit] + termPendingCount[unit] < termPollDepth[unit])
+        return;
+    
+    // no interrupt for each character while we watch the device ourselves
+    termPolling[unit] = 1;
+    termXmitOn[unit] = 0;
+    termSetInterrupts(unit);
+    
+    int since = USLOSS_Clock();
+    while (!termXmitOn[unit] && USLOSS_Clock() - since < TERM_POLL_USEC &&
+           termWritesQueued[unit] + termPendingCount[unit] >= termPollDepth[unit])
     {
-        procStruct tmp = ProcTable[i];
-        USLOSS_Console("pid %5d privateMboxID %d wakeTime %d\n", tmp.pid, tmp.privateMboxID, tmp.wakeTime);
+        // the receive side stays with the interrupt, only the transmit bit is looked at
+        USLOSS_DeviceInput(USLOSS_TERM_DEV, unit, &status);
+        if (USLOSS_TERM_STAT_XMIT(status) != USLOSS_DEV_READY)
+            continue;
+        
+        termTransmit(unit);
+        termStat[unit].polledChars++;
+        since = USLOSS_Clock();
     }
-} /* printProcTable */
-
-/* ------------------------- addSleepRequest ----------------------------------- */
-void addSleepRequest(procPtr* list, procPtr newSleep)
-{
-    if(debugflag4)
-        USLOSS_Console("addSleepRequest(): pid %d, wakeTime %d\n", newSleep->pid, newSleep->wakeTime);
+    termPolling[unit] = 0;
     
-    // add to empty list
-    if (*list == NULL)
+    // whatever is left goes out on interrupts again
+    if (!termXmitOn[unit] && !termOutputIdle(unit))
     {
-        *list = newSleep;
-        return;
+        termXmitOn[unit] = 1;
+        termSetInterrupts(unit);
     }
-    // add to the head
-    procPtr tmp = *list;
-    if(tmp->wakeTime > newSleep->wakeTime)
+} /* end of termPollTransmit */
+/* ------------------------- termNextLine ----------------------------------- */
+// purpose: move the next queued line into xmitRing without blocking, 0 if no writer is waiting
+int termNextLine(int unit)
+{
+    termWriteReq* pending = termPending[unit];
+    
+    // take everything queued so an urgent record can go ahead of older ones
+    while (termPendingCount[unit] < TERM_WRITE_SLOTS &&
+           MboxCondReceive(termWriteMbox[unit], &pending[termPendingCount[unit]], sizeof(termWriteReq)) >= 0)
     {
-        newSleep->nextSleepPtr = *list;
-        *list = newSleep;
-        return;
+        termPendingCount[unit]++;
+        
+        // a slot opened up for another writer, loopback calls us with interrupts already disabled
+        int psr = USLOSS_PsrGet();
+        disableInterrupts();
+        termWritesQueued[unit]--;
+        termSelectWake();
+        USLOSS_PsrSet(psr);
     }
-    // normal cases
-    procPtr prev = NULL;
-    procPtr curr = *list;
-    while(curr->wakeTime < newSleep->wakeTime)
+    
+    if (termPendingCount[unit] == 0)
+        return 0;
+    
+    int pick = termPickRecord(unit);
+    termWriteReq req = pending[pick];
+    termPendingCount[unit]--;
+    memmove(&pending[pick], &pending[pick + 1], (termPendingCount[unit] - pick) * sizeof(termWriteReq));
+    
+    if (debugflag4)
+        USLOSS_Console("\ttermNextLine(): going to write line size %d of pid %d on term %d, urgent %d\n", req.size, req.owner, unit, req.urgent);
+    
+    termXmitSize[unit] = req.size;
+    termXmitPID[unit] = req.pid;
+    termXmitQueuedAt[unit] = req.queuedAt;
+    
+    if (req.iov != NULL)
     {
-        prev = curr;
-        curr = curr->nextSleepPtr;
-        if(curr == NULL)
-            break;
+        termXmitIov[unit] = req.iov;
+        termXmitIovLeft[unit] = req.iovCount;
+        termXmitFill(unit);
+        return 1;
     }
-    prev->nextSleepPtr = newSleep;
-    newSleep->nextSleepPtr = curr;
     
-    return;
-} /* end of addSleepRequest */
+    int i;
+    for (i = 0; i < req.size; i++)
+        ringPut(&xmitRing[unit], req.data[i]);
+    
+    return 1;
+} /* end of termNextLine */
 
-/* ------------------------- printSleepList ----------------------------------- */
-void printSleepList()
+/* ------------------------- termPickRecord ----------------------------------- */
+// purpose: index of the pending record to transmit next, the oldest of the most urgent ones
+//          that would not overtake an earlier record of its own writer
+int termPickRecord(int unit)
 {
-    procPtr tmp = sleepList;
-    while(tmp != NULL)
+    termWriteReq* pending = termPending[unit];
+    int best = 0;
+    int i, j;
+    
+    for (i = 1; i < termPendingCount[unit]; i++)
     {
-        USLOSS_Console("\t printSleepList(): %d blocked on %d wakeTime %d\n", tmp->pid, tmp->privateMboxID, tmp->wakeTime);
-        tmp = tmp->nextSleepPtr;
+        if (pending[i].urgent <= pending[best].urgent)
+            continue;
+        
+        for (j = 0; j < i; j++)
+            if (pending[j].owner == pending[i].owner)
+                break;
+        if (j == i)
+            best = i;
     }
-} /* end of printSleepList */
+    
+    return best;
+} /* end of termPickRecord */
+/* ------------------------- termQueueBehind ----------------------------------- */
+// purpose: write-behind, queue copies of buf in records of up to MAXLINE bytes that complete nobody
+void termQueueBehind(int unit, char* buf, int size)
+{
+    termWriteReq req;
+    req.pid = -1;
+    req.owner = getpid();
+    req.urgent = 0;
+    req.iov = NULL;
+    
+    do {
+        req.size = size < MAXLINE ? size : MAXLINE;
+        memcpy(req.data, buf, req.size);
+        req.queuedAt = USLOSS_Clock();
+        
+        // TermDriver decrements it with interrupts disabled
+        disableInterrupts();
+        termWritesQueued[unit]++;
+        enableInterrupts();
+        MboxSend(termWriteMbox[unit], &req, TERM_WRITE_REQ_SIZE(req.size));
+        
+        // keep TermDriver going in case the queue is full and we have to wait
+        termKick(unit);
+        
+        buf += req.size;
+        size -= req.size;
+    } while (size > 0);
+} /* end of termQueueBehind */
+
+/* ------------------------- termSendAndWait ----------------------------------- */
+// purpose: queue a write record for TermDriver and block until it is transmitted, returns the bytes written
+int termSendAndWait(int unit, termWriteReq* req, int msgSize)
+{
+    procPtr writer = &ProcTable[getpid() % MAXPROC];
+    writer->pid = getpid();
+    
+    req->queuedAt = USLOSS_Clock();
+    
+    // TermDriver decrements it with interrupts disabled
+    disableInterrupts();
+    termWritesQueued[unit]++;
+    enableInterrupts();
+    MboxSend(termWriteMbox[unit], req, msgSize);
+    termKick(unit);
+    
+    // block until TermDriver sent the last character
+    MboxReceive(writer->waitMboxID, NULL, 0);
+    
+    return writer->waitSize;
+} /* end of termSendAndWait */
 
-/* ------------------------- addDiskRequest ----------------------------------- */
-// similar with addSleepList, same algorithm, be careful with the track directions
-void addDiskRequest(procPtr* diskReqQueue, procPtr newDisk)
+/* ------------------------- termKick ----------------------------------- */
+// purpose: after queueing a record, have TermDriver transmit it, right away or once the combining window closes
+void termKick(int unit)
 {
-    if (debugflag4)
-        USLOSS_Console("addDiskRequest(): inserting request for track #%d\n", newDisk->track);
+    if (termWritesQueued[unit] + termPendingCount[unit] > termStat[unit].writeQueueHigh)
+        termStat[unit].writeQueueHigh = termWritesQueued[unit] + termPendingCount[unit];
     
-    procPtr head = *diskReqQueue;
-    if (*diskReqQueue == NULL)
+    // the peer's line discipline takes the record right away
+    if (termLoopPeer[unit] >= 0)
     {
-        *diskReqQueue = newDisk;
+        disableInterrupts();
+        termLoopPump(unit);
+        enableInterrupts();
         return;
     }
-    // adding when track is to the left of current
-    else if (head->track < newDisk->track)
+    
+    // TermDriver is transmitting or polling and takes the record when it gets to it
+    if (termXmitOn[unit] || termPolling[unit])
+        return;
+    
+    // idle unit, give other writers a few ticks to add their fragments
+    if (termCombine[unit] > 0)
     {
-        procPtr prev = NULL;
-        procPtr tmp = *diskReqQueue;
-        
-        while (tmp->track < newDisk->track)
-        {
-            if (tmp->track < head->track)
-            {
-                prev->nextDiskPtr = newDisk;
-                newDisk->nextDiskPtr = tmp;
-                return;
-            }
-            prev = tmp;
-            tmp = tmp->nextDiskPtr;
-            if (tmp == NULL)
-                break;
-        }
-        prev->nextDiskPtr = newDisk;
-        newDisk->nextDiskPtr = tmp;
+        disableInterrupts();
+        if (termCombineLeft[unit] == 0)
+            termCombineLeft[unit] = termCombine[unit];
+        enableInterrupts();
+        return;
     }
-    // adding when track is to the right of current
-    else
+    
+    // TermDriver picks the record up on the next transmit interrupt
+    termXmitOn[unit] = 1;
+    termSetInterrupts(unit);
+} /* end of termKick */
+
+/* ------------------------- termCombineTick ----------------------------------- */
+// purpose: called by ClockDriver on every tick, start transmitting on units whose combining window closed
+void termCombineTick()
+{
+    int unit;
+    
+    for (unit = 0; unit < USLOSS_TERM_UNITS; unit++)
     {
-        procPtr prev = NULL;
-        procPtr tmp = *diskReqQueue;
+        if (termCombineLeft[unit] == 0)
+            continue;
         
-        while (tmp->track > newDisk->track)
+        termCombineLeft[unit]--;
+        if (termCombineLeft[unit] == 0)
         {
-            prev = tmp;
-            tmp = tmp->nextDiskPtr;
-            if (tmp == NULL)
-                break;
-            if (tmp->track < head->track)
-                break;
+            termXmitOn[unit] = 1;
+            termSetInterrupts(unit);
         }
-        if (debugflag4)
-            USLOSS_Console("\t\t wrapped around, tmp %d, prev %d\n", tmp == NULL ? -1 : tmp->track, prev->track);
-        if (tmp == NULL)
+    }
+} /* end of termCombineTick */
+
+/* ------------------------- termOutputIdle ----------------------------------- */
+// purpose: 1 if nothing is queued on or being transmitted by a unit
+int termOutputIdle(int unit)
+{
+    return termWritesQueued[unit] == 0 && termPendingCount[unit] == 0 && termXmitSize[unit] < 0;
+} /* end of termOutputIdle */
+
+/* ------------------------- termFlushWake ----------------------------------- */
+// purpose: wake the TermFlush callers of a unit once its output drained
+void termFlushWake(int unit)
+{
+    int psr = USLOSS_PsrGet();
+    disableInterrupts();
+    if (termOutputIdle(unit))
+    {
+        while (termFlushWaiters[unit] != NULL)
         {
-            prev->nextDiskPtr = newDisk;
-            newDisk->nextDiskPtr = NULL;
-            return;
+            MboxCondSend(termFlushWaiters[unit]->waitMboxID, NULL, 0);
+            termFlushWaiters[unit] = termFlushWaiters[unit]->nextWaitPtr;
         }
-        while (tmp->track <= newDisk->track)
+    }
+    USLOSS_PsrSet(psr);
+} /* end of termFlushWake */
+
+/* ------------------------- termXmitFill ----------------------------------- */
+// purpose: copy as much of a long write as fits from the writer's pieces into xmitRing
+void termXmitFill(int unit)
+{
+    while (ringCount(&xmitRing[unit]) < xmitRing[unit].size)
+    {
+        // current piece done, go on with the next one
+        if (termXmitLeft[unit] == 0)
         {
-            prev = tmp;
-            tmp = tmp->nextDiskPtr;
-            if (tmp == NULL)
-                break;
+            if (termXmitIovLeft[unit] == 0)
+                return;
+            termXmitBuf[unit] = termXmitIov[unit]->base;
+            termXmitLeft[unit] = termXmitIov[unit]->len;
+            termXmitIov[unit]++;
+            termXmitIovLeft[unit]--;
+            continue;
         }
-        if (debugflag4)
-            USLOSS_Console("\t\t out of loop, tmp %d, prev %d\n", tmp == NULL ? -1 : tmp->track, prev->track);
         
-        prev->nextDiskPtr = newDisk;
-        newDisk->nextDiskPtr = tmp;
-        return;
+        ringPut(&xmitRing[unit], *termXmitBuf[unit]);
+        termXmitBuf[unit]++;
+        termXmitLeft[unit]--;
+    }
+} /* end of termXmitFill */
+
+/* ------------------------- ringInit ----------------------------------- */
+void ringInit(byteRing* ring, int size)
+{
+    ring->buf = malloc(size);
+    if (ring->buf == NULL)
+    {
+        USLOSS_Console("ringInit(): can't allocate %d bytes. Halting...\n", size);
+        USLOSS_Halt(1);
     }
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+} /* end of ringInit */
+
+/* ------------------------- ringCount ----------------------------------- */
+int ringCount(byteRing* ring)
+{
+    return ring->tail - ring->head;
+} /* end of ringCount */
+
+/* ------------------------- ringPut ----------------------------------- */
+// purpose: append one character, 1 if the ring is full and the character was not stored
+int ringPut(byteRing* ring, char c)
+{
+    if (ringCount(ring) == ring->size)
+        return 1;
     
-    return;
-} /* end of addDiskRequest */
+    ring->buf[ring->tail % ring->size] = c;
+    ring->tail++;
+    
+    return 0;
+} /* end of ringPut */
 
-/* ------------------------- printDiskReqQueue ----------------------------------- */
-void printDiskReqQueue(procPtr* diskReqQueue)
+/* ------------------------- ringGet ----------------------------------- */
+// purpose: take the oldest character out, the caller checks ringCount first
+char ringGet(byteRing* ring)
 {
-    procPtr tmp = *diskReqQueue;
-    while(tmp != NULL)
+    char c = ring->buf[ring->head % ring->size];
+    ring->head++;
+    
+    return c;
+} /* end of ringGet */
+
+/* ------------------------- ringPeek ----------------------------------- */
+// purpose: the oldest character without taking it out, the caller checks ringCount first
+char ringPeek(byteRing* ring)
+{
+    return ring->buf[ring->head % ring->size];
+} /* end of ringPeek */
+
+/* ------------------------- diskSectorIO ----------------------------------- */
+// purpose: read or write one sector of the current track on behalf of DiskDriver, returns the disk status register
+int diskSectorIO(int unit, int opr, int sector, char* buf)
+{
+    int status;
+    USLOSS_DeviceRequest req;
+    
+    req.opr = opr;
+    req.reg1 = (void*)(long)sector;
+    req.reg2 = (void*)(long)buf;
+    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req);
+    waitDevice(USLOSS_DISK_DEV, unit, &status);
+    
+    return status;
+} /* end of diskSectorIO */
+
+/* ------------------------- initDiskReqPool ----------------------------------- */
+void initDiskReqPool()
+{
+    int i;
+    
+    diskReqFree = NULL;
+    for (i = 0; i < DISK_REQ_POOL; i++)
     {
-        USLOSS_Console("\t printDiskReqQueue(): %d wants to %s on track %d\n", tmp->pid, tmp->opr == USLOSS_DISK_WRITE ? "write" : "read", tmp->track);
-        tmp = tmp->nextDiskPtr;
+        diskReqPool[i].nextDiskPtr = diskReqFree;
+        diskReqFree = &diskReqPool[i];
     }
-} /* end of printDiskReqQueue */
+} /* end of initDiskReqPool */
 
-/* ------------------------- dequeueDiskReq ----------------------------------- */
-void dequeueDiskReq(procPtr* diskQueue)
+/* ------------------------- allocDiskReq ----------------------------------- */
+// purpose: take a request from the pool for a stacked device, the free list is linked through nextDiskPtr
+diskReqPtr allocDiskReq()
 {
-    procPtr head = *diskQueue;
-    *diskQueue = head->nextDiskPtr;
-    return;
-}
+    diskReqPtr req = diskReqFree;
+    
+    if (req == NULL)
+    {
+        USLOSS_Console("allocDiskReq(): out of disk requests. Halting...\n");
+        USLOSS_Halt(1);
+    }
+    diskReqFree = req->nextDiskPtr;
+    
+    return req;
+} /* end of allocDiskReq */
+
+/* ------------------------- freeDiskReq ----------------------------------- */
+void freeDiskReq(diskReqPtr req)
+{
+    req->nextDiskPtr = diskReqFree;
+    diskReqFree = req;
+} /* end of freeDiskReq */
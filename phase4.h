@@ -11,6 +11,135 @@
 
 #define MAXLINE         80
 
+/*
+ * Virtual disk units, numbered apart from the physical ones so that units
+ * 2 and 3 stay invalid
+ */
+
+#define DISK_MIRROR_UNIT        10  // RAID-1 over disk0 and disk1
+#define DISK_RAM_UNIT           11  // served from kernel memory
+
+/*
+ * Default number of tracks of the RAM disk, can be overridden at startup
+ * through the RAMDISK_TRACKS environment variable
+ */
+
+#define RAMDISK_TRACKS          16
+
+/*
+ * Sectors DiskCopy moves per kernel staging buffer
+ */
+
+#define DISK_COPY_CHUNK         16
+
+/*
+ * Default bytes of unread input buffered per terminal unit, can be
+ * overridden at startup through the TERM_INPUT_SIZE environment variable
+ */
+
+#define TERM_INPUT_SIZE         (8 * MAXLINE)
+
+/*
+ * TermControl requests, and the input modes of TERM_CTL_MODE
+ */
+
+#define TERM_CTL_MODE           0   // TERM_MODE_LINE or TERM_MODE_RAW
+#define TERM_CTL_RAW_MIN        1   // bytes a raw TermRead waits for, 0 to never wait
+#define TERM_CTL_RAW_TIME       2   // milliseconds a raw TermRead waits at most, 0 for no limit
+#define TERM_CTL_WRITE_BEHIND   3   // 1 if TermWrite returns once its data is queued, see TermFlush
+#define TERM_CTL_COMBINE        4   // clock ticks an idle unit collects writes before it transmits them
+#define TERM_CTL_POLL_DEPTH     5   // queued records at which TermDriver polls for transmit ready, 0 to never poll
+#define TERM_CTL_LOOPBACK       6   // unit whose input receives this unit's output and back, -1 to disconnect
+
+#define TERM_MODE_LINE          0   // TermRead returns one line
+#define TERM_MODE_RAW           1   // TermRead returns bytes as they arrive
+
+/*
+ * Lines TermWrite callers can queue on a unit, and the TermSelect mask
+ * bits of each unit
+ */
+
+#define TERM_WRITE_SLOTS        10
+#define TERM_SELECT_READ(unit)  (1 << (unit))
+#define TERM_SELECT_WRITE(unit) (1 << ((unit) + USLOSS_TERM_UNITS))
+
+/*
+ * Default queue depth at which TermDriver stops waiting for transmit
+ * interrupts and polls the device, and how many microseconds it polls for
+ * one character before it goes back to waiting for the interrupt
+ */
+
+#define TERM_POLL_DEPTH         4
+#define TERM_POLL_USEC          (1000 * USLOSS_CLOCK_MS)
+
+/*
+ * Returned by TermTryRead and TermTryWrite when the call would have to wait
+ */
+
+#define TERM_WOULD_BLOCK        1
+
+/*
+ * Kernel pipes that can exist at once, and the largest buffer one can have
+ */
+
+#define MAXPIPES                16
+#define PIPE_MAX_SIZE           4096
+
+/*
+ * Phase 4 system call numbers not provided by usyscall.h
+ */
+
+#define SYS_DISKMIRRORSTATS     30
+#define SYS_DISKPREAD           31
+#define SYS_DISKPWRITE          32
+#define SYS_DISKCOPY            33
+#define SYS_TERMCONTROL         34
+#define SYS_TERMSELECT          35
+#define SYS_TERMTRYREAD         36
+#define SYS_TERMTRYWRITE        37
+#define SYS_TERMFLUSH           38
+#define SYS_TERMREADLINES       39
+#define SYS_TERMWRITEV          40
+#define SYS_TERMWRITEURGENT     41
+#define SYS_PIPECREATE          42
+#define SYS_PIPEREAD            43
+#define SYS_PIPEWRITE           44
+#define SYS_TERMSTATS           45
+#define SYS_PIPECLOSE           46
+
+/*
+ * Read balancing statistics of the mirrored unit
+ */
+
+typedef struct diskMirrorStats {
+    int reads[2];       // reads served by disk0 and disk1
+    int queuePicks;     // reads routed to the unit with the shorter queue
+    int nearestPicks;   // reads routed to the unit with the closer head
+    int writes;         // writes, each one issued to both units
+} diskMirrorStats;
+
+/*
+ * Traffic statistics of a terminal unit. Latencies are counted in
+ * TERM_LAT_BUCKETS buckets, bucket i holds those under 4^i milliseconds
+ * and the last one everything longer
+ */
+
+#define TERM_LAT_BUCKETS        8
+
+typedef struct termStats {
+    int wakeups;        // times TermDriver woke up
+    int polledChars;    // characters sent after polling instead of a transmit interrupt
+    int bytesIn;        // characters received
+    int bytesOut;       // characters transmitted
+    int linesIn;        // lines assembled
+    int linesOut;       // write records transmitted
+    int drops;          // received characters lost because the input buffer was full
+    int inputHigh;      // most bytes of unread input buffered at once
+    int writeQueueHigh; // most write records queued at once
+    int readLatency[TERM_LAT_BUCKETS];  // lines, from their first character received to a reader having them
+    int writeLatency[TERM_LAT_BUCKETS]; // write records, from queued to transmitted
+} termStats;
+
 /*
  * Function prototypes for this phase.
  */
@@ -22,6 +151,13 @@ extern  int  DiskRead (void *diskBuffer, int unit, int track, int first,
 extern  int  DiskWrite(void *diskBuffer, int unit, int track, int first,
                        int sectors, int *status);
 extern  int  DiskSize (int unit, int *sector, int *track, int *disk);
+extern  int  DiskMirrorStats(struct diskMirrorStats *stats);
+extern  int  DiskPread (void *buffer, int unit, int offset, int length,
+                        int *status);
+extern  int  DiskPwrite(void *buffer, int unit, int offset, int length,
+                        int *status);
+extern  int  DiskCopy (int srcUnit, int srcTrack, int srcFirst, int dstUnit,
+                       int dstTrack, int dstFirst, int sectors, int *status);
 extern  int  TermRead (char *buffer, int bufferSize, int unitID,
                        int *numCharsRead);
 extern  int  TermWrite(char *buffer, int bufferSize, int unitID,
@@ -38,15 +174,76 @@ struct procStruct{
     procPtr     nextSleepPtr;
     int         privateMboxID; // used in self blocked
     int         wakeTime; // in microsecond
-    procPtr     nextDiskPtr;
+    procPtr     nextWaitPtr; // next process waiting on the same terminal or pipe
+    char*       waitBuf; // where TermDriver or a pipe writer hands bytes to this process
+    int         waitSize; // size of waitBuf, then the number of bytes handed, -1 if the pipe was closed
+    int         waitMboxID; // one slot, posted once a driver or pipe finished this process's request
+    int         selectMask; // TERM_SELECT_* conditions a TermSelect waits on
+};
+
+/*----------phase4 disk request ----------*/
+typedef struct diskReq diskReq;
+typedef struct diskReq *diskReqPtr;
+
+struct diskReq{
+    int         pid;
     int         opr;
     char*       buf;
     int         sectors;
     int         track;
     int         first;
+    int         offset; // byte offset into the first sector
+    int         length; // bytes to transfer, partial sectors are read-modify-written
     int         unit;
+    int         status; // 0, or the disk status register if the transfer failed
+    int         doneMboxID; // completion is sent here
+    int         pooled; // taken from the request pool by a stacked device
+    diskReqPtr  next; // next request of the same batch
+    diskReqPtr  nextDiskPtr; // next request on a driver's queue
 };
 
+#define DISK_REQ_POOL           (2 * MAXPROC)
+
+/*----------phase4 byte ring ----------*/
+// one process puts characters in and one takes them out, each only moves its own index
+typedef struct byteRing {
+    char*       buf;
+    int         size;
+    unsigned    head; // characters taken out so far
+    unsigned    tail; // characters put in so far
+} byteRing;
+
+#define TERM_XMIT_SIZE          (MAXLINE + 1)
+
+/*----------phase4 terminal write request ----------*/
+// one piece of a TermWriteV
+typedef struct termIovec {
+    char*       base;
+    int         len;
+} termIovec;
+
+// one TermWrite on its way to TermDriver, only the used part of data is sent
+typedef struct termWriteReq {
+    int         pid; // writer to complete, -1 if nobody waits
+    int         owner; // process that wrote it, its records go out in the order it wrote them
+    int         urgent; // goes ahead of ordinary records queued on the unit
+    int         size;
+    int         queuedAt; // USLOSS_Clock() when it was queued
+    termIovec*  iov; // a long or vectored write stays in the writer's buffers, NULL if it is in data
+    int         iovCount;
+    char        data[MAXLINE];
+} termWriteReq;
+
+#define TERM_WRITE_REQ_SIZE(size)   (sizeof(termWriteReq) - MAXLINE + (size))
+
+/*----------phase4 block device ----------*/
+typedef struct blockDevOps {
+    int  (*submit)(int unit, diskReqPtr reqs); // queue a batch, returns how many completions to wait for
+    void (*complete)(diskReqPtr req); // called by the backend once a request is done
+    int  (*geometry)(int unit, int *sector, int *track, int *disk);
+    int  (*flush)(int unit);
+} blockDevOps;
+
 #define ERR_INVALID             -1
 #define ERR_OK                  0
 
@@ -0,0 +1,64 @@
+/* MIRRORTEST
+ * - note that the test script should clean out the disk files
+ * each time before running this test.
+ * Write two sectors to the mirrored unit, check that both disk0 and
+ * disk1 hold them, then read them back through the mirror and print
+ * the read balancing statistics.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char sectors[2 * 512];
+static char copy[2 * 512];
+int start4(char *arg)
+{
+    int result;
+    int status;
+    int unit, i;
+    int sectorSize, trackSize, diskSize;
+    diskMirrorStats stats;
+
+    DiskSize(DISK_MIRROR_UNIT, &sectorSize, &trackSize, &diskSize);
+    USLOSS_Console("start4(): mirror sector size %d, track size %d, ",
+                   sectorSize, trackSize);
+    USLOSS_Console("disk size %d\n", diskSize);
+
+    USLOSS_Console("start4(): Writing data to 2 mirrored sectors\n");
+    strcpy(&sectors[0 * 512], "Written once\n");
+    strcpy(&sectors[1 * 512], "Stored twice\n");
+    result = DiskWrite((char *) sectors, DISK_MIRROR_UNIT, 3, 4, 2, &status);
+    assert(result == 0);
+
+    for (unit = 0; unit < 2; unit++) {
+        memset(copy, 0, sizeof(copy));
+        result = DiskRead((char *) copy, unit, 3, 4, 2, &status);
+        assert(result == 0);
+        USLOSS_Console("start4(): disk %d: %s", unit, &copy[0*512]);
+        USLOSS_Console("start4(): disk %d: %s", unit, &copy[1*512]);
+    }
+
+    for (i = 0; i < 4; i++) {
+        memset(copy, 0, sizeof(copy));
+        result = DiskRead((char *) copy, DISK_MIRROR_UNIT, 3, 4, 2, &status);
+        assert(result == 0);
+        assert(strcmp(&copy[1*512], "Stored twice\n") == 0);
+    }
+
+    result = DiskMirrorStats(&stats);
+    assert(result == 0);
+    USLOSS_Console("start4(): mirror writes %d, reads %d + %d\n",
+                   stats.writes, stats.reads[0], stats.reads[1]);
+    assert(stats.reads[0] + stats.reads[1] == 4);
+
+    Terminate(24);
+    return 0;
+}
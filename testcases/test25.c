@@ -0,0 +1,53 @@
+/* RAMDISKTEST
+ * Write three sectors to the ram disk starting at track 2, sector 15
+ * -- should wrap around to track 3 -- and read them back.  Neither
+ * disk0 nor disk1 is touched.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char sectors[3 * 512];
+static char copy[3 * 512];
+int start4(char *arg)
+{
+    int result;
+    int status;
+    int sectorSize, trackSize, diskSize;
+
+    result = DiskSize(DISK_RAM_UNIT, &sectorSize, &trackSize, &diskSize);
+    assert(result == 0);
+    USLOSS_Console("start4(): ram disk sector size %d, track size %d, ",
+                   sectorSize, trackSize);
+    USLOSS_Console("disk size %d\n", diskSize);
+
+    USLOSS_Console("start4(): Writing data to 3 ram disk sectors, wrapping ");
+    USLOSS_Console("to next track\n");
+    strcpy(&sectors[0 * 512], "Scratch one\n");
+    strcpy(&sectors[1 * 512], "Scratch two\n");
+    strcpy(&sectors[2 * 512], "Scratch three\n");
+    result = DiskWrite((char *) sectors, DISK_RAM_UNIT, 2, 15, 3, &status);
+    assert(result == 0);
+    result = DiskRead((char *) copy, DISK_RAM_UNIT, 2, 15, 3, &status);
+    assert(result == 0);
+    assert(memcmp(sectors, copy, sizeof(copy)) == 0);
+    USLOSS_Console("start4(): Read from ram disk: %s", &copy[0*512]);
+    USLOSS_Console("start4(): Read from ram disk: %s", &copy[1*512]);
+    USLOSS_Console("start4(): Read from ram disk: %s", &copy[2*512]);
+
+    result = DiskRead((char *) copy, DISK_RAM_UNIT, diskSize, 0, 1, &status);
+    assert(result == -1);
+    USLOSS_Console("start4(): reading past the last track returned %d\n",
+                   result);
+
+    Terminate(25);
+    return 0;
+}
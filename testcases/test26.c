@@ -0,0 +1,59 @@
+/* PREADTEST
+ * - note that the test script should clean out the disk file
+ * each time before running this test.
+ * Fill two sectors of disk0, then patch 16 bytes straddling the
+ * sector boundary with DiskPwrite and read them back with DiskPread.
+ * The rest of both sectors must be left alone.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char sectors[2 * 512];
+static char copy[2 * 512];
+int start4(char *arg)
+{
+    int result;
+    int status;
+    int offset;
+    char record[17];
+
+    memset(sectors, '.', sizeof(sectors));
+    result = DiskWrite((char *) sectors, 0, 2, 3, 2, &status);
+    assert(result == 0);
+
+    // track 2, sector 3 starts at byte (2 * 16 + 3) * 512
+    offset = (2 * 16 + 3) * 512 + 504;
+    USLOSS_Console("start4(): patching 16 bytes at offset %d\n", offset);
+    result = DiskPwrite("0123456789abcdef", 0, offset, 16, &status);
+    assert(result == 0);
+
+    memset(record, 0, sizeof(record));
+    result = DiskPread(record, 0, offset, 16, &status);
+    assert(result == 0);
+    assert(strcmp(record, "0123456789abcdef") == 0);
+    USLOSS_Console("start4(): DiskPread returned %s\n", record);
+
+    result = DiskRead((char *) copy, 0, 2, 3, 2, &status);
+    assert(result == 0);
+    assert(copy[503] == '.' && copy[520] == '.');
+    assert(memcmp(&copy[504], "0123456789abcdef", 16) == 0);
+    USLOSS_Console("start4(): bytes 500-523 of the sectors: %.24s\n",
+                   &copy[500]);
+
+    result = DiskPread(record, 0, 16 * 16 * 512 - 8, 16, &status);
+    assert(result == -1);
+    USLOSS_Console("start4(): reading past the end of the disk returned %d\n",
+                   result);
+
+    Terminate(26);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* COPYTEST
+ * - note that the test script should clean out the disk files
+ * each time before running this test.
+ * Write three sectors to disk0 starting at track 1, sector 14, copy
+ * them to disk1 track 6, sector 0 with DiskCopy and read them back.
+ * Then copy 40 sectors of disk1 to the ram disk, which takes several
+ * staging buffers, and compare both copies.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char sectors[40 * 512];
+static char copy[40 * 512];
+int start4(char *arg)
+{
+    int result;
+    int status;
+    int i;
+
+    strcpy(&sectors[0 * 512], "First sector\n");
+    strcpy(&sectors[1 * 512], "Second sector\n");
+    strcpy(&sectors[2 * 512], "Third sector\n");
+    result = DiskWrite((char *) sectors, 0, 1, 14, 3, &status);
+    assert(result == 0);
+
+    USLOSS_Console("start4(): copying 3 sectors from disk0 to disk1\n");
+    result = DiskCopy(0, 1, 14, 1, 6, 0, 3, &status);
+    assert(result == 0);
+    result = DiskRead((char *) copy, 1, 6, 0, 3, &status);
+    assert(result == 0);
+    assert(memcmp(sectors, copy, 3 * 512) == 0);
+    for (i = 0; i < 3; i++)
+        USLOSS_Console("start4(): Read from disk1: %s", &copy[i * 512]);
+
+    USLOSS_Console("start4(): copying 40 sectors from disk1 to the ram disk\n");
+    result = DiskCopy(1, 4, 5, DISK_RAM_UNIT, 0, 3, 40, &status);
+    assert(result == 0);
+    result = DiskRead((char *) sectors, 1, 4, 5, 40, &status);
+    assert(result == 0);
+    result = DiskRead((char *) copy, DISK_RAM_UNIT, 0, 3, 40, &status);
+    assert(result == 0);
+    assert(memcmp(sectors, copy, sizeof(copy)) == 0);
+    USLOSS_Console("start4(): copies %s\n",
+                   memcmp(sectors, copy, sizeof(copy)) == 0 ? "match" : "differ");
+
+    result = DiskCopy(0, 0, 0, 0, 0, 2, 4, &status);
+    assert(result == -1);
+    USLOSS_Console("start4(): overlapping forward copy returned %d\n", result);
+
+    Terminate(27);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/* TERMTEST
+ * Switch term1 to raw mode and read its first four bytes, then go back
+ * to line mode for the rest of the line. Finally read in raw mode with
+ * a timer, which returns whatever arrived by the time it runs out.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+int start4(char *arg)
+{
+    char buf[MAXLINE + 1];
+    int  result;
+    int  len;
+
+    USLOSS_Console("start4(): switching term1 to raw mode, 4 bytes at least\n");
+    result = TermControl(1, TERM_CTL_MODE, TERM_MODE_RAW);
+    assert(result == 0);
+    result = TermControl(1, TERM_CTL_RAW_MIN, 4);
+    assert(result == 0);
+
+    result = TermRead(buf, 4, 1, &len);
+    assert(result == 0);
+    buf[len] = '\0';
+    USLOSS_Console("start4(): raw read of %d bytes: '%s'\n", len, buf);
+
+    USLOSS_Console("start4(): back to line mode\n");
+    result = TermControl(1, TERM_CTL_MODE, TERM_MODE_LINE);
+    assert(result == 0);
+    result = TermRead(buf, MAXLINE, 1, &len);
+    assert(result == 0);
+    buf[len] = '\0';
+    USLOSS_Console("start4(): rest of the line: '%s'\n", buf);
+
+    USLOSS_Console("start4(): raw read of up to %d bytes with a 500 ms timer\n",
+                   MAXLINE);
+    TermControl(1, TERM_CTL_MODE, TERM_MODE_RAW);
+    TermControl(1, TERM_CTL_RAW_MIN, MAXLINE);
+    TermControl(1, TERM_CTL_RAW_TIME, 500);
+    result = TermRead(buf, MAXLINE, 1, &len);
+    assert(result == 0);
+    USLOSS_Console("start4(): raw read returned %s\n",
+                   len > 0 && len <= MAXLINE ? "some bytes" : "a bad size");
+
+    result = TermControl(1, TERM_CTL_MODE, 7);
+    assert(result == -1);
+    USLOSS_Console("start4(): unknown mode returned %d\n", result);
+
+    Terminate(28);
+    return 0;
+}
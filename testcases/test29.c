@@ -0,0 +1,57 @@
+/* TERMTEST
+ * A single process serves all four terminals: it waits on all of them
+ * with TermSelect and reads the first line of each unit as soon as that
+ * unit has one. The lines are printed in unit order at the end.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+int start4(char *arg)
+{
+    char lines[USLOSS_TERM_UNITS][MAXLINE + 1];
+    int  mask = 0;
+    int  ready;
+    int  result;
+    int  len;
+    int  unit;
+
+    for (unit = 0; unit < USLOSS_TERM_UNITS; unit++)
+        mask |= TERM_SELECT_READ(unit);
+
+    USLOSS_Console("start4(): waiting on all terminals with TermSelect\n");
+    while (mask != 0) {
+        result = TermSelect(mask, -1, &ready);
+        assert(result == 0);
+        assert(ready != 0 && (ready & ~mask) == 0);
+        for (unit = 0; unit < USLOSS_TERM_UNITS; unit++) {
+            if ((ready & TERM_SELECT_READ(unit)) == 0)
+                continue;
+            result = TermRead(lines[unit], MAXLINE, unit, &len);
+            assert(result == 0);
+            lines[unit][len] = '\0';
+            mask &= ~TERM_SELECT_READ(unit);
+        }
+    }
+    for (unit = 0; unit < USLOSS_TERM_UNITS; unit++)
+        USLOSS_Console("start4(): term%d: %s", unit, lines[unit]);
+
+    result = TermSelect(TERM_SELECT_WRITE(2), 0, &ready);
+    USLOSS_Console("start4(): term2 writable right away: %s\n",
+                   result == 0 && ready == TERM_SELECT_WRITE(2) ? "yes" : "no");
+
+    result = TermSelect(0, 0, &ready);
+    assert(result == -1);
+    USLOSS_Console("start4(): empty mask returned %d\n", result);
+
+    Terminate(29);
+    return 0;
+}
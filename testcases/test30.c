@@ -0,0 +1,47 @@
+/* TERMTEST
+ * Poll term0 with TermTryRead until its first line arrives, then queue
+ * three lines on term1 with TermTryWrite, retrying whenever the unit is
+ * busy. Sleep at the end so the last line is out before the drivers quit.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+int start4(char *arg)
+{
+    char buf[MAXLINE + 1];
+    int  result;
+    int  len;
+    int  i;
+
+    USLOSS_Console("start4(): polling term0\n");
+    while ((result = TermTryRead(buf, MAXLINE, 0, &len)) == TERM_WOULD_BLOCK)
+        ;
+    assert(result == 0);
+    buf[len] = '\0';
+    USLOSS_Console("start4(): read from term0: %s", buf);
+
+    for (i = 0; i < 3; i++) {
+        sprintf(buf, "start4: queued line %d without waiting\n", i);
+        while ((result = TermTryWrite(buf, strlen(buf), 1, &len)) == TERM_WOULD_BLOCK)
+            ;
+        assert(result == 0 && len == strlen(buf));
+        USLOSS_Console("start4(): queued line %d on term1\n", i);
+    }
+
+    result = TermTryWrite(buf, MAXLINE + 1, 1, &len);
+    assert(result == -1);
+    USLOSS_Console("start4(): oversized line returned %d\n", result);
+
+    Sleep(1);
+    Terminate(30);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/* TERMTEST
+ * Write a report of 20 lines, much longer than MAXLINE, to term2 with a
+ * single TermWrite and check that all of it was written.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char report[20 * MAXLINE];
+int start4(char *arg)
+{
+    int result;
+    int size;
+    int i;
+
+    report[0] = '\0';
+    for (i = 0; i < 20; i++)
+        sprintf(report + strlen(report), "report line %2d of a long dump\n", i);
+
+    USLOSS_Console("start4(): writing %d bytes to term2 in one call\n",
+                   (int) strlen(report));
+    result = TermWrite(report, strlen(report), 2, &size);
+    assert(result == 0);
+    assert(size == strlen(report));
+    USLOSS_Console("start4(): TermWrite wrote %d bytes\n", size);
+
+    Terminate(31);
+    return 0;
+}
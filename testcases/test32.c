@@ -0,0 +1,50 @@
+/* TERMTEST
+ * Put term3 in write-behind mode, write a short and a long buffer, which
+ * both return before they are transmitted, then wait for them with
+ * TermFlush.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char buf[4 * MAXLINE];
+int start4(char *arg)
+{
+    int result;
+    int size;
+    int i;
+
+    result = TermControl(3, TERM_CTL_WRITE_BEHIND, 1);
+    assert(result == 0);
+
+    strcpy(buf, "start4: a log line written behind\n");
+    result = TermWrite(buf, strlen(buf), 3, &size);
+    assert(result == 0 && size == strlen(buf));
+    USLOSS_Console("start4(): first TermWrite returned, %d bytes queued\n", size);
+
+    buf[0] = '\0';
+    for (i = 0; i < 6; i++)
+        sprintf(buf + strlen(buf), "start4: behind, record part %d\n", i);
+    result = TermWrite(buf, strlen(buf), 3, &size);
+    assert(result == 0 && size == strlen(buf));
+    USLOSS_Console("start4(): second TermWrite returned, %d bytes queued\n", size);
+
+    result = TermFlush(3);
+    assert(result == 0);
+    USLOSS_Console("start4(): TermFlush returned, term3 is drained\n");
+
+    result = TermFlush(4);
+    assert(result == -1);
+    USLOSS_Console("start4(): TermFlush of unit 4 returned %d\n", result);
+
+    Terminate(32);
+    return 0;
+}
@@ -0,0 +1,45 @@
+/* TERMTEST
+ * Let lines pile up on term0, then read them in batches with
+ * TermReadLines until six lines have been read, printing each one.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+static char buf[4 * MAXLINE];
+int start4(char *arg)
+{
+    int lens[8];
+    int total = 0;
+    int lines;
+    int result;
+    int i;
+    char *line;
+
+    Sleep(2);
+
+    while (total < 6) {
+        result = TermReadLines(buf, sizeof(buf), 0, lens, 6 - total, &lines);
+        assert(result == 0 && lines >= 1 && lines <= 6 - total);
+        line = buf;
+        for (i = 0; i < lines; i++) {
+            USLOSS_Console("start4(): line %d: %.*s", total + i, lens[i], line);
+            line += lens[i];
+        }
+        total += lines;
+    }
+
+    result = TermReadLines(buf, sizeof(buf), 0, lens, 0, &lines);
+    assert(result == -1);
+    USLOSS_Console("start4(): room for no lines returned %d\n", result);
+
+    Terminate(33);
+    return 0;
+}
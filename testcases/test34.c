@@ -0,0 +1,44 @@
+/* TERMTEST
+ * Write a structured log record built from four separate pieces to term0
+ * with a single TermWriteV.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <string.h>
+
+
+int start4(char *arg)
+{
+    char      level[] = "[warn] ";
+    char      where[] = "test34: ";
+    char      what[] = "disk queue is getting long";
+    char      end[] = "\n";
+    termIovec iov[4] = {
+        {level, sizeof(level) - 1},
+        {where, sizeof(where) - 1},
+        {what,  sizeof(what) - 1},
+        {end,   sizeof(end) - 1},
+    };
+    int       result;
+    int       size;
+
+    result = TermWriteV(iov, 4, 0, &size);
+    assert(result == 0);
+    assert(size == 7 + 8 + 26 + 1);
+    USLOSS_Console("start4(): TermWriteV wrote %d bytes from 4 pieces\n", size);
+
+    iov[1].len = -1;
+    result = TermWriteV(iov, 4, 0, &size);
+    assert(result == -1);
+    USLOSS_Console("start4(): a negative length returned %d\n", result);
+
+    Terminate(34);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* TERMTEST
+ * Open a combining window of 5 ticks on term1 and let three children
+ * each write a short fragment of one line. The fragments are collected
+ * while the window is open and transmitted together, and every child
+ * is completed once its own fragment is out. TermStats shows all three
+ * records were queued at once, none was taken before the window closed.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static char *fragments[] = {"combined: one, ", "two, ", "three\n"};
+
+int Child(char *arg)
+{
+    int  i = atoi(arg);
+    int  result;
+    int  size;
+
+    result = TermWrite(fragments[i], strlen(fragments[i]), 1, &size);
+    assert(result == 0 && size == strlen(fragments[i]));
+    USLOSS_Console("Child%d(): fragment of %d bytes written\n", i, size);
+
+    Terminate(i);
+    return 0;
+}
+
+int start4(char *arg)
+{
+    char      name[16];
+    termStats stats;
+    int       pid;
+    int       status;
+    int       result;
+    int       i;
+
+    TermControl(1, TERM_CTL_COMBINE, 5);
+
+    for (i = 0; i < 3; i++) {
+        sprintf(name, "%d", i);
+        Spawn("Child", Child, name, USLOSS_MIN_STACK, 2, &pid);
+    }
+    for (i = 0; i < 3; i++)
+        Wait(&pid, &status);
+
+    USLOSS_Console("start4(): all fragments are out\n");
+
+    result = TermStats(1, &stats);
+    assert(result == 0 && stats.linesOut == 3);
+    assert(stats.writeQueueHigh == 3);
+    USLOSS_Console("start4(): the fragments went out in one pass\n");
+    Terminate(35);
+    return 0;
+}
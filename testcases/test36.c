@@ -0,0 +1,100 @@
+/* TERMTEST
+ * Loop term2 back to term3 and fill term3's input with filler lines
+ * nobody reads yet, so further output of term2 stays queued. start4
+ * queues three ordinary lines A0..A2 with write-behind. Child1 writes
+ * the urgent line U1. Child2 writes an ordinary line C0 and then the
+ * urgent line U2. Once start4 reads term3, U1 goes ahead of everything
+ * still queued. U2 may not overtake its own writer's C0. The lines must
+ * come out as U1 A0 A1 A2 C0 U2.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static char *expected[] = {"<U1>", "<A0>", "<A1>", "<A2>", "<C0>", "<U2>"};
+
+static void writeLine(char *tag, int urgent)
+{
+    char line[MAXLINE];
+    int  result;
+    int  size;
+
+    sprintf(line, "%s\n", tag);
+    if (urgent)
+        result = TermWriteUrgent(line, strlen(line), 2, &size);
+    else
+        result = TermWrite(line, strlen(line), 2, &size);
+    assert(result == 0 && size == strlen(line));
+}
+
+int Child1(char *arg)
+{
+    writeLine("<U1>", 1);
+    Terminate(1);
+    return 0;
+}
+
+int Child2(char *arg)
+{
+    writeLine("<C0>", 0);
+    writeLine("<U2>", 1);
+    Terminate(2);
+    return 0;
+}
+
+int start4(char *arg)
+{
+    char line[MAXLINE + 1];
+    char filler[MAXLINE];
+    int  pid1, pid2;
+    int  status;
+    int  result;
+    int  found = 0;
+    int  size;
+    int  i;
+
+    result = TermControl(2, TERM_CTL_LOOPBACK, 3);
+    assert(result == 0);
+    TermControl(2, TERM_CTL_WRITE_BEHIND, 1);
+
+    // more than term3 buffers, the last fillers stay queued on term2
+    memset(filler, 'f', MAXLINE - 5);
+    filler[MAXLINE - 5] = '\n';
+    for (i = 0; i < 10; i++)
+        TermWrite(filler, MAXLINE - 4, 2, &size);
+
+    writeLine("<A0>", 0);
+    writeLine("<A1>", 0);
+    writeLine("<A2>", 0);
+    Spawn("Child1", Child1, NULL, USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("Child2", Child2, NULL, USLOSS_MIN_STACK, 2, &pid2);
+
+    // every read makes room, and term2 moves its most urgent record next
+    while (found < 6) {
+        result = TermRead(line, MAXLINE, 3, &size);
+        assert(result == 0);
+        line[size] = '\0';
+        for (i = 0; i < 6; i++) {
+            if (strstr(line, expected[i]) != NULL) {
+                USLOSS_Console("start4(): read %s\n", expected[i]);
+                assert(i == found);
+                found++;
+            }
+        }
+    }
+
+    Wait(&pid1, &status);
+    Wait(&pid2, &status);
+    USLOSS_Console("start4(): urgent lines went ahead, each writer kept its order\n");
+    Terminate(36);
+    return 0;
+}
@@ -0,0 +1,47 @@
+/* TERMTEST
+ * Lower the polling depth of term3 to 2 and queue eight lines with
+ * write-behind. TermDriver polls for transmit ready while the backlog
+ * is deep and goes back to interrupts for the last lines; all eight
+ * lines come out in order and some characters were sent after polling.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int start4(char *arg)
+{
+    char      line[MAXLINE];
+    termStats stats;
+    int       result;
+    int       size;
+    int       i;
+
+    result = TermControl(3, TERM_CTL_POLL_DEPTH, 2);
+    assert(result == 0);
+    TermControl(3, TERM_CTL_WRITE_BEHIND, 1);
+
+    for (i = 0; i < 8; i++) {
+        sprintf(line, "burst line %d\n", i);
+        result = TermWrite(line, strlen(line), 3, &size);
+        assert(result == 0 && size == strlen(line));
+    }
+
+    TermFlush(3);
+    USLOSS_Console("start4(): all burst lines are out\n");
+
+    result = TermStats(3, &stats);
+    assert(result == 0 && stats.linesOut == 8);
+    assert(stats.polledChars > 0);
+    USLOSS_Console("start4(): term3 polled for some characters\n");
+    Terminate(37);
+    return 0;
+}
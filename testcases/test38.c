@@ -0,0 +1,69 @@
+/* TERMTEST
+ * Connect term2 and term3 back to back. A child writes three lines on
+ * term2 and start4 reads them from term3 through the line discipline,
+ * then one line goes back the other way. Disconnect both units at the
+ * end.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int Child(char *arg)
+{
+    char line[MAXLINE];
+    int  result;
+    int  size;
+    int  i;
+
+    for (i = 0; i < 3; i++) {
+        sprintf(line, "looped line %d\n", i);
+        result = TermWrite(line, strlen(line), 2, &size);
+        assert(result == 0 && size == strlen(line));
+    }
+
+    result = TermRead(line, MAXLINE, 2, &size);
+    assert(result == 0);
+    USLOSS_Console("Child(): read back '%.*s'\n", size - 1, line);
+
+    Terminate(1);
+    return 0;
+}
+
+int start4(char *arg)
+{
+    char line[MAXLINE];
+    char *reply = "reply from term3\n";
+    int  pid;
+    int  status;
+    int  result;
+    int  size;
+    int  i;
+
+    result = TermControl(2, TERM_CTL_LOOPBACK, 3);
+    assert(result == 0);
+
+    Spawn("Child", Child, NULL, USLOSS_MIN_STACK, 2, &pid);
+
+    for (i = 0; i < 3; i++) {
+        result = TermRead(line, MAXLINE, 3, &size);
+        assert(result == 0);
+        USLOSS_Console("start4(): read '%.*s' from term3\n", size - 1, line);
+    }
+
+    TermWrite(reply, strlen(reply), 3, &size);
+    Wait(&pid, &status);
+
+    result = TermControl(2, TERM_CTL_LOOPBACK, -1);
+    assert(result == 0);
+    Terminate(38);
+    return 0;
+}
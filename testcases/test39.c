@@ -0,0 +1,96 @@
+/* TERMTEST
+ * Create a 16 byte pipe. A consumer at higher priority blocks on the
+ * empty pipe and gets the producer's first bytes copied straight into
+ * its buffer; the rest of a 40 byte message waits in the pipe, which
+ * makes the producer block until the consumer made room.
+ * Then close the pipe, create it again and close it under a blocked
+ * reader, which gets -1.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int pipeID;
+
+int Consumer(char *arg)
+{
+    char buf[MAXLINE];
+    int  total = 0;
+    int  result;
+    int  size;
+
+    // how the bytes are split over the reads depends on scheduling, print them all at once
+    while (total < 40) {
+        result = PipeRead(buf + total, 10, pipeID, &size);
+        assert(result == 0 && size > 0);
+        total += size;
+    }
+    USLOSS_Console("Consumer(): read %d bytes '%.*s'\n", total, total, buf);
+
+    Terminate(1);
+    return 0;
+}
+
+int Closed(char *arg)
+{
+    char buf[MAXLINE];
+    int  result;
+    int  size;
+
+    result = PipeRead(buf, 10, pipeID, &size);
+    assert(result == -1);
+    USLOSS_Console("Closed(): read on pipe %d returned %d\n", pipeID, result);
+
+    Terminate(2);
+    return 0;
+}
+
+int start4(char *arg)
+{
+    char *message = "0123456789abcdefghijklmnopqrstuvwxyzABCD";
+    int  pid;
+    int  status;
+    int  result;
+    int  size;
+
+    result = PipeCreate(16, &pipeID);
+    assert(result == 0);
+    result = PipeCreate(0, &pid);
+    assert(result == -1);
+
+    Spawn("Consumer", Consumer, NULL, USLOSS_MIN_STACK, 2, &pid);
+
+    result = PipeWrite(message, strlen(message), pipeID, &size);
+    assert(result == 0 && size == strlen(message));
+
+    Wait(&pid, &status);
+    USLOSS_Console("start4(): wrote %d bytes to pipe %d\n", size, pipeID);
+
+    result = PipeClose(pipeID);
+    assert(result == 0);
+    result = PipeClose(pipeID);
+    assert(result == -1);
+    result = PipeWrite(message, 1, pipeID, &size);
+    assert(result == -1);
+
+    result = PipeCreate(16, &pipeID);
+    assert(result == 0 && pipeID == 0);
+    USLOSS_Console("start4(): created pipe %d again\n", pipeID);
+
+    Spawn("Closed", Closed, NULL, USLOSS_MIN_STACK, 2, &pid);
+    result = PipeClose(pipeID);
+    assert(result == 0);
+
+    Wait(&pid, &status);
+    Terminate(39);
+    return 0;
+}
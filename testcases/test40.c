@@ -0,0 +1,65 @@
+/* TERMTEST
+ * Read three lines from term0 and write three lines to term1, then
+ * print the statistics of both units. Every line read and written is
+ * counted once in the latency histogram of its direction.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <libuser.h>
+#include <assert.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase4.h>
+#include <usyscall.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int histTotal(int *hist)
+{
+    int total = 0;
+    int i;
+
+    for (i = 0; i < TERM_LAT_BUCKETS; i++)
+        total += hist[i];
+    return total;
+}
+
+int start4(char *arg)
+{
+    char      line[MAXLINE];
+    termStats stats;
+    int       result;
+    int       size;
+    int       written = 0;
+    int       i;
+
+    for (i = 0; i < 3; i++) {
+        result = TermRead(line, MAXLINE, 0, &size);
+        assert(result == 0);
+        sprintf(line, "stats line %d\n", i);
+        result = TermWrite(line, strlen(line), 1, &size);
+        assert(result == 0);
+        written += size;
+    }
+
+    result = TermStats(0, &stats);
+    assert(result == 0);
+    assert(histTotal(stats.readLatency) == 3);
+    USLOSS_Console("start4(): term0 received input %d, lines read %d\n",
+                   stats.bytesIn > 0, histTotal(stats.readLatency));
+
+    result = TermStats(1, &stats);
+    assert(result == 0);
+    assert(stats.linesOut == 3 && histTotal(stats.writeLatency) == 3);
+    assert(stats.bytesOut == written);
+    USLOSS_Console("start4(): term1 bytes out %d, lines out %d, written %d, queue high %d\n",
+                   stats.bytesOut, stats.linesOut, histTotal(stats.writeLatency),
+                   stats.writeQueueHigh);
+
+    result = TermStats(4, &stats);
+    assert(result == -1);
+    Terminate(40);
+    return 0;
+}